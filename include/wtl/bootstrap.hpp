@@ -0,0 +1,202 @@
+#pragma once
+#ifndef WTL_BOOTSTRAP_HPP_
+#define WTL_BOOTSTRAP_HPP_
+
+#include "numeric.hpp"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <future>
+#include <utility>
+#include <algorithm>
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+namespace wtl {
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
+namespace detail {
+
+// Replicates are processed in fixed-size blocks, each with its own engine
+// seeded by (seed, block); results do not depend on the number of workers.
+constexpr size_t replicate_block = 64u;
+
+inline std::mt19937_64 block_engine(uint64_t seed, uint64_t block) {
+    std::seed_seq seq{
+      static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32u),
+      static_cast<uint32_t>(block), static_cast<uint32_t>(block >> 32u)
+    };
+    return std::mt19937_64(seq);
+}
+
+// run_block(engine, begin, end, out) fills out[begin, end);
+// blocks the caller until all blocks finish
+template <class Pool, class RunBlock> inline
+std::vector<double> run_replicates(Pool& pool, size_t replicates, uint64_t seed, RunBlock& run_block) {
+    std::vector<double> out(replicates);
+    auto task = [&run_block, &out, seed](size_t block) {
+        auto engine = block_engine(seed, block);
+        const size_t begin_ = block * replicate_block;
+        const size_t end_ = std::min(begin_ + replicate_block, out.size());
+        run_block(engine, begin_, end_, out.data());
+    };
+    const size_t nblocks = (replicates + replicate_block - 1u) / replicate_block;
+    std::vector<std::future<void>> futures;
+    futures.reserve(nblocks);
+    for (size_t block=0; block<nblocks; ++block) {
+        futures.push_back(pool.submit(task, block));
+    }
+    for (auto& f: futures) {f.wait();}
+    for (auto& f: futures) {f.get();}
+    return out;
+}
+
+} // namespace detail
+
+// The bootstrap functions block until every replicate has run on pool;
+// do not call them from a task running on the same pool, where waiting
+// workers can leave no thread to run the blocks.
+
+// Bootstrap distribution of stat(indices), where indices are n draws
+// with replacement from [0, n) held in a buffer reused within a block.
+template <class Pool, class Statistic> inline
+std::vector<double>
+bootstrap_indices(Pool& pool, size_t n, Statistic stat, size_t replicates, uint64_t seed) {
+    auto run_block = [n, &stat](std::mt19937_64& engine, size_t begin_, size_t end_, double* out) {
+        std::uniform_int_distribution<size_t> uniform(0u, n - 1u);
+        std::vector<size_t> indices(n);
+        for (size_t r=begin_; r<end_; ++r) {
+            for (auto& i: indices) {i = uniform(engine);}
+            out[r] = stat(indices);
+        }
+    };
+    return detail::run_replicates(pool, replicates, seed, run_block);
+}
+
+// Bootstrap distribution of stat(resample), where resample is a
+// std::vector<T>& that stat may modify, e.g., for wtl::median(&resample).
+template <class Pool, class T, class Statistic> inline
+std::vector<double>
+bootstrap(Pool& pool, const std::vector<T>& data, Statistic stat, size_t replicates, uint64_t seed) {
+    const size_t n = data.size();
+    auto run_block = [n, &data, &stat](std::mt19937_64& engine, size_t begin_, size_t end_, double* out) {
+        std::uniform_int_distribution<size_t> uniform(0u, n - 1u);
+        std::vector<T> resample(n);
+        for (size_t r=begin_; r<end_; ++r) {
+            for (auto& x: resample) {x = data[uniform(engine)];}
+            out[r] = stat(resample);
+        }
+    };
+    return detail::run_replicates(pool, replicates, seed, run_block);
+}
+
+// Paired bootstrap: stat(x_resample, y_resample) with shared indices,
+// e.g., for wtl::cor_spearman
+template <class Pool, class T, class U, class Statistic> inline
+std::vector<double>
+bootstrap(Pool& pool, const std::vector<T>& x, const std::vector<U>& y, Statistic stat, size_t replicates, uint64_t seed) {
+    if (x.size() != y.size()) throw std::invalid_argument("x.size() != y.size() in bootstrap()");
+    const size_t n = x.size();
+    auto run_block = [n, &x, &y, &stat](std::mt19937_64& engine, size_t begin_, size_t end_, double* out) {
+        std::uniform_int_distribution<size_t> uniform(0u, n - 1u);
+        std::vector<T> xr(n);
+        std::vector<U> yr(n);
+        for (size_t r=begin_; r<end_; ++r) {
+            for (size_t i=0; i<n; ++i) {
+                const auto idx = uniform(engine);
+                xr[i] = x[idx];
+                yr[i] = y[idx];
+            }
+            out[r] = stat(xr, yr);
+        }
+    };
+    return detail::run_replicates(pool, replicates, seed, run_block);
+}
+
+// Equal-tailed percentile interval of a replicate distribution.
+// Throw std::invalid_argument on empty input or level outside (0, 1).
+inline std::pair<double, double>
+percentile_interval(std::vector<double> distribution, double level=0.95) {
+    if (distribution.empty()) throw std::invalid_argument("empty distribution in percentile_interval()");
+    if (!(0.0 < level && level < 1.0)) throw std::invalid_argument("level not in (0, 1) in percentile_interval()");
+    const double alpha = 0.5 * (1.0 - level);
+    const double lower = quantile(&distribution, alpha);
+    const double upper = quantile(&distribution, 1.0 - alpha);
+    return {lower, upper};
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
+class PermutationResult {
+  public:
+    PermutationResult(double observed, std::vector<double>&& distribution) noexcept:
+      observed_(observed), distribution_(std::move(distribution)) {}
+
+    double observed() const noexcept {return observed_;}
+    const std::vector<double>& distribution() const noexcept {return distribution_;}
+
+    // (1 + #extreme) / (1 + replicates) counts the observed arrangement
+    double p_greater() const {
+        return p_value([this](double t) {return t >= observed_;});
+    }
+    double p_less() const {
+        return p_value([this](double t) {return t <= observed_;});
+    }
+    double p_two_sided() const {
+        return std::min(2.0 * std::min(p_greater(), p_less()), 1.0);
+    }
+
+  private:
+    template <class Pred>
+    double p_value(Pred pred) const {
+        const auto extreme = std::count_if(distribution_.begin(), distribution_.end(), pred);
+        return static_cast<double>(extreme + 1) / static_cast<double>(distribution_.size() + 1u);
+    }
+
+    double observed_;
+    std::vector<double> distribution_;
+};
+
+// Two-sample test: x and y are pooled, shuffled, and split in the
+// original sizes; stat(x_permuted, y_permuted)
+template <class Pool, class T, class Statistic> inline
+PermutationResult
+permutation_test(Pool& pool, const std::vector<T>& x, const std::vector<T>& y, Statistic stat, size_t replicates, uint64_t seed) {
+    const auto nx = static_cast<ptrdiff_t>(x.size());
+    auto run_block = [nx, &x, &y, &stat](std::mt19937_64& engine, size_t begin_, size_t end_, double* out) {
+        std::vector<T> pooled(x);
+        pooled.insert(pooled.end(), y.begin(), y.end());
+        std::vector<T> xp(x.size());
+        std::vector<T> yp(y.size());
+        for (size_t r=begin_; r<end_; ++r) {
+            std::shuffle(pooled.begin(), pooled.end(), engine);
+            std::copy(pooled.begin(), pooled.begin() + nx, xp.begin());
+            std::copy(pooled.begin() + nx, pooled.end(), yp.begin());
+            out[r] = stat(xp, yp);
+        }
+    };
+    const double observed = stat(x, y);
+    return {observed, detail::run_replicates(pool, replicates, seed, run_block)};
+}
+
+// Test of association: y is shuffled against fixed x; stat(x, y_permuted)
+template <class Pool, class T, class U, class Statistic> inline
+PermutationResult
+permutation_test_paired(Pool& pool, const std::vector<T>& x, const std::vector<U>& y, Statistic stat, size_t replicates, uint64_t seed) {
+    if (x.size() != y.size()) throw std::invalid_argument("x.size() != y.size() in permutation_test_paired()");
+    auto run_block = [&x, &y, &stat](std::mt19937_64& engine, size_t begin_, size_t end_, double* out) {
+        std::vector<U> yp(y);
+        for (size_t r=begin_; r<end_; ++r) {
+            std::shuffle(yp.begin(), yp.end(), engine);
+            out[r] = stat(x, yp);
+        }
+    };
+    const double observed = stat(x, y);
+    return {observed, detail::run_replicates(pool, replicates, seed, run_block)};
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+} // namespace wtl
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
+#endif /* WTL_BOOTSTRAP_HPP_ */
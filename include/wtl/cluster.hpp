@@ -4,10 +4,20 @@
 
 #include "random.hpp"
 #include "signed.hpp"
+#include "numeric.hpp"
+#include "concurrent.hpp"
 
 #include <cmath>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <numeric>
+#include <stdexcept>
+#include <atomic>
+#include <unordered_map>
+#include <type_traits>
 
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 namespace wtl { namespace cluster {
@@ -25,31 +35,218 @@ double euclidean_distance(const Array& lhs, const Array& rhs) {
     return std::sqrt(sum_squared);
 }
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// distance metrics
+//
+// operator()(x, y, dim) on contiguous rows is written to be vectorized;
+// operator()(lhs, rhs) accepts any pair of indexable arrays.
+
+namespace detail {
+
+template <class Derived>
+struct MetricBase {
+    template <class Array>
+    double operator()(const Array& lhs, const Array& rhs) const {
+        const auto n = static_cast<size_t>(lhs.size());
+        double result = 0.0;
+        for (size_t i=0; i<n; ++i) {
+            result += Derived::term(static_cast<double>(lhs[i]), static_cast<double>(rhs[i]));
+        }
+        return Derived::finish(result);
+    }
+    template <class T>
+    double operator()(const T* x, const T* y, size_t dim) const {
+        double result = 0.0;
+        for (size_t i=0; i<dim; ++i) {
+            result += Derived::term(static_cast<double>(x[i]), static_cast<double>(y[i]));
+        }
+        return Derived::finish(result);
+    }
+};
+
+} // namespace detail
+
+struct SquaredEuclidean: detail::MetricBase<SquaredEuclidean> {
+    static double term(double x, double y) noexcept {x -= y; return x * x;}
+    static double finish(double s) noexcept {return s;}
+};
+
+struct Euclidean: detail::MetricBase<Euclidean> {
+    static double term(double x, double y) noexcept {x -= y; return x * x;}
+    static double finish(double s) noexcept {return std::sqrt(s);}
+};
+
+struct Manhattan: detail::MetricBase<Manhattan> {
+    static double term(double x, double y) noexcept {return std::abs(x - y);}
+    static double finish(double s) noexcept {return s;}
+};
+
+// number of differing coordinates
+struct Hamming: detail::MetricBase<Hamming> {
+    static double term(double x, double y) noexcept {return (x != y) ? 1.0 : 0.0;}
+    static double finish(double s) noexcept {return s;}
+};
+
+namespace detail {
+
+// whether Metric satisfies the triangle inequality
+template <class Metric>
+struct is_metric: std::true_type {};
+template <>
+struct is_metric<SquaredEuclidean>: std::false_type {};
+
+} // namespace detail
+
+// Copy std::vector<Array> into contiguous row-major storage
+template <class Points> inline
+Matrix<double> as_matrix(const Points& points) {
+    const size_t n = points.size();
+    const size_t dim = n ? static_cast<size_t>(points[0u].size()) : 0u;
+    Matrix<double> out(n, dim);
+    for (size_t i=0; i<n; ++i) {
+        for (size_t j=0; j<dim; ++j) {
+            out(i, j) = static_cast<double>(points[i][j]);
+        }
+    }
+    return out;
+}
+
+inline const Matrix<double>& as_matrix(const Matrix<double>& points) noexcept {
+    return points;
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// condensed distance matrix
+
+// Upper triangle without diagonal, row by row as in scipy.spatial.distance.pdist
+class DistanceMatrix {
+  public:
+    DistanceMatrix() = default;
+    explicit DistanceMatrix(size_t n):
+      n_(n), data_(n * (n - (n > 0u)) / 2u) {}
+
+    // k for i < j
+    size_t index(size_t i, size_t j) const noexcept {
+        return n_ * i - i * (i + 1u) / 2u + (j - i - 1u);
+    }
+    // (i, j) for k
+    std::pair<size_t, size_t> pair(size_t k) const noexcept {
+        const auto n = static_cast<double>(n_);
+        const auto dk = static_cast<double>(k);
+        auto i = static_cast<size_t>(n - 2.0 - std::floor(std::sqrt(4.0 * n * (n - 1.0) - 8.0 * dk - 7.0) / 2.0 - 0.5));
+        // guard against rounding of sqrt for very large n
+        while (i > 0u && index(i, i + 1u) > k) --i;
+        while (i + 2u < n_ && index(i + 1u, i + 2u) <= k) ++i;
+        return {i, k - index(i, i + 1u) + i + 1u};
+    }
+
+    double operator()(size_t i, size_t j) const noexcept {
+        if (i == j) return 0.0;
+        if (j < i) std::swap(i, j);
+        return data_[index(i, j)];
+    }
+    double& at(size_t i, size_t j) noexcept {return data_[index(i, j)];}
+
+    size_t n() const noexcept {return n_;}
+    size_t size() const noexcept {return data_.size();}
+    double* data() noexcept {return data_.data();}
+    const double* data() const noexcept {return data_.data();}
+    const std::vector<double>& values() const noexcept {return data_;}
+
+  private:
+    size_t n_ = 0u;
+    std::vector<double> data_;
+};
+
+namespace detail {
+
+// Rows [ib, iend) against rows j > i, in tiles of `block` columns
+// so that both groups of points stay in cache.
+template <class Metric> inline
+void pdist_rows(const Matrix<double>& points, Metric metric, DistanceMatrix* out,
+                size_t ib, size_t iend, size_t block) {
+    const size_t n = points.nrow();
+    const size_t dim = points.ncol();
+    for (size_t jb=ib; jb<n; jb+=block) {
+        const size_t jend = std::min(jb + block, n);
+        for (size_t i=ib; i<iend; ++i) {
+            const double* x = points.row(i).data();
+            // index(i, j) = offset + j; unsigned wrap-around cancels out
+            const size_t offset = out->index(i, i + 1u) - (i + 1u);
+            for (size_t j=std::max(jb, i + 1u); j<jend; ++j) {
+                out->data()[offset + j] = metric(x, points.row(j).data(), dim);
+            }
+        }
+    }
+}
+
+} // namespace detail
+
+// Throws std::invalid_argument if block == 0
+template <class Metric=Euclidean> inline
+DistanceMatrix pdist(const Matrix<double>& points, Metric metric=Metric{}, size_t block=64u) {
+    if (block == 0u) throw std::invalid_argument("block == 0 in pdist()");
+    DistanceMatrix out(points.nrow());
+    for (size_t ib=0; ib<points.nrow(); ib+=block) {
+        detail::pdist_rows(points, metric, &out, ib, std::min(ib + block, points.nrow()), block);
+    }
+    return out;
+}
+
+// Parallel over blocks of rows with ThreadPool-like pool.
+// Blocks with more pairs are submitted first.
+template <class Pool, class Metric=Euclidean> inline
+DistanceMatrix pdist(Pool& pool, const Matrix<double>& points, Metric metric=Metric{}, size_t block=64u) {
+    if (block == 0u) throw std::invalid_argument("block == 0 in pdist()");
+    const size_t n = points.nrow();
+    DistanceMatrix out(n);
+    auto task = [&points, metric, &out, block, n](size_t b) {
+        const size_t ib = b * block;
+        detail::pdist_rows(points, metric, &out, ib, std::min(ib + block, n), block);
+    };
+    wtl::parallel_for(pool, size_t{0u}, (n + block - 1u) / block, size_t{1u}, task);
+    return out;
+}
+
 template <class T, class URBG>
 class PAM {
   public:
     PAM(const std::vector<T>& points, ptrdiff_t k, URBG&& engine, const int max_iteration)
     : points_(points), labels_(points.size()) {
-        const auto n = ssize(points);
+        SerialPool serial;
+        run(serial, k, engine, max_iteration);
+    }
+
+    // Assignment and medoid selection are distributed over pool;
+    // labels and medoids are identical to the serial version.
+    template <class Pool>
+    PAM(Pool& pool, const std::vector<T>& points, ptrdiff_t k, URBG&& engine, const int max_iteration)
+    : points_(points), labels_(points.size()) {
+        run(pool, k, engine, max_iteration);
+    }
+
+    const auto& points() const noexcept {return points_;}
+    const auto& labels() const noexcept {return labels_;}
+    const auto& medoids() const noexcept {return medoids_;}
+
+  private:
+    template <class Pool>
+    void run(Pool& pool, ptrdiff_t k, URBG& engine, const int max_iteration) {
+        const auto n = ssize(points_);
         const auto indices = wtl::sample(n, k, engine);
         medoids_.assign(indices.begin(), indices.end());
         for (auto step = decltype(max_iteration){}; step < max_iteration; ++step) {
-            for (ptrdiff_t i=0; i<n; ++i) {
+            wtl::parallel_for(pool, ptrdiff_t{0}, n, ptrdiff_t{1}, [this](ptrdiff_t i) {
                 at(labels_, i) = classify(i);
-            }
+            }, Schedule::fixed);
             auto prev_medoids = medoids_;
-            for (ptrdiff_t i=0; i<k; ++i) {
+            wtl::parallel_for(pool, ptrdiff_t{0}, k, ptrdiff_t{1}, [this](ptrdiff_t i) {
                 at(medoids_, i) = select_medoid(i);
-            }
+            });
             if (medoids_ == prev_medoids) break;
         }
     }
 
-    const auto& points() const noexcept {return points_;}
-    const auto& labels() const noexcept {return labels_;}
-    const auto& medoids() const noexcept {return medoids_;}
-
-  private:
     ptrdiff_t classify(ptrdiff_t i) const {
         const auto& x = at(points_, i);
         double min_dist = std::numeric_limits<double>::max();
@@ -94,6 +291,1408 @@ auto pam(const T& points, ptrdiff_t k, URBG&& engine, int max_iteration=10) {
     return PAM<typename T::value_type, URBG>(points, k, std::forward<URBG>(engine), max_iteration);
 }
 
+template <class Pool, class T, class URBG> inline
+auto pam(Pool& pool, const T& points, ptrdiff_t k, URBG&& engine, int max_iteration=10) {
+    return PAM<typename T::value_type, URBG>(pool, points, k, std::forward<URBG>(engine), max_iteration);
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// FastPAM: Schubert and Rousseeuw (2019) arXiv:1810.05691
+//
+// Works on precomputed distances and keeps, for each point, the distances
+// to its nearest and second-nearest medoids. BUILD initializes medoids
+// greedily; each SWAP iteration evaluates all k exchanges for a candidate
+// in one O(n) pass (FastPAM1) and applies the best one overall.
+
+class FastPAM {
+  public:
+    FastPAM(const DistanceMatrix& dist, ptrdiff_t k, int max_iteration=100)
+    : n_(dist.n()), k_(static_cast<size_t>(k)),
+      nearest_(n_), d_nearest_(n_), d_second_(n_) {
+        if (k < 1 || n_ < k_) throw std::invalid_argument("FastPAM requires 0 < k <= n");
+        build(dist);
+        for (int step=0; step<max_iteration; ++step) {
+            if (!swap(dist)) break;
+        }
+        labels_.assign(nearest_.begin(), nearest_.end());
+    }
+
+    const auto& labels() const noexcept {return labels_;}
+    const auto& medoids() const noexcept {return medoids_;}
+    // sum of distances to the nearest medoid
+    double cost() const noexcept {
+        return std::accumulate(d_nearest_.begin(), d_nearest_.end(), 0.0);
+    }
+
+  private:
+    void build(const DistanceMatrix& dist) {
+        // the point minimizing total distance, then greedy additions
+        std::vector<double> column_sums(n_);
+        for (size_t i=0; i<n_; ++i) {
+            for (size_t j=i + 1u; j<n_; ++j) {
+                const double d = dist(i, j);
+                column_sums[i] += d;
+                column_sums[j] += d;
+            }
+        }
+        const auto first = std::min_element(column_sums.begin(), column_sums.end()) - column_sums.begin();
+        medoids_.push_back(first);
+        for (size_t o=0; o<n_; ++o) {
+            d_nearest_[o] = dist(o, static_cast<size_t>(first));
+        }
+        std::vector<bool> is_medoid(n_);
+        is_medoid[static_cast<size_t>(first)] = true;
+        while (medoids_.size() < k_) {
+            double best_gain = -1.0;
+            size_t best = 0u;
+            for (size_t c=0; c<n_; ++c) {
+                if (is_medoid[c]) continue;
+                double gain = 0.0;
+                for (size_t o=0; o<n_; ++o) {
+                    gain += std::max(d_nearest_[o] - dist(o, c), 0.0);
+                }
+                if (gain > best_gain) {
+                    best_gain = gain;
+                    best = c;
+                }
+            }
+            medoids_.push_back(static_cast<ptrdiff_t>(best));
+            is_medoid[best] = true;
+            for (size_t o=0; o<n_; ++o) {
+                d_nearest_[o] = std::min(d_nearest_[o], dist(o, best));
+            }
+        }
+        update_nearest(dist);
+    }
+
+    void update_nearest(const DistanceMatrix& dist) {
+        for (size_t o=0; o<n_; ++o) {
+            double d1 = std::numeric_limits<double>::max();
+            double d2 = std::numeric_limits<double>::max();
+            size_t m1 = 0u;
+            for (size_t m=0; m<k_; ++m) {
+                const double d = dist(o, static_cast<size_t>(medoids_[m]));
+                if (d < d1) {
+                    d2 = d1;
+                    d1 = d;
+                    m1 = m;
+                } else if (d < d2) {
+                    d2 = d;
+                }
+            }
+            nearest_[o] = static_cast<ptrdiff_t>(m1);
+            d_nearest_[o] = d1;
+            d_second_[o] = d2;
+        }
+    }
+
+    // Apply the best improving swap; false if none
+    bool swap(const DistanceMatrix& dist) {
+        std::vector<double> removal_loss(k_);
+        for (size_t o=0; o<n_; ++o) {
+            removal_loss[static_cast<size_t>(nearest_[o])] += d_second_[o] - d_nearest_[o];
+        }
+        std::vector<bool> is_medoid(n_);
+        for (const auto m: medoids_) {is_medoid[static_cast<size_t>(m)] = true;}
+        double best_delta = 0.0;
+        size_t best_medoid = 0u;
+        size_t best_candidate = n_;
+        std::vector<double> delta(k_);
+        for (size_t c=0; c<n_; ++c) {
+            if (is_medoid[c]) continue;
+            delta = removal_loss;
+            double shared = 0.0;
+            for (size_t o=0; o<n_; ++o) {
+                const double d_oc = dist(o, c);
+                const auto m = static_cast<size_t>(nearest_[o]);
+                if (d_oc < d_nearest_[o]) {
+                    shared += d_oc - d_nearest_[o];
+                    delta[m] += d_nearest_[o] - d_second_[o];
+                } else if (d_oc < d_second_[o]) {
+                    delta[m] += d_oc - d_second_[o];
+                }
+            }
+            const auto it = std::min_element(delta.begin(), delta.end());
+            const double total = *it + shared;
+            if (total < best_delta) {
+                best_delta = total;
+                best_medoid = static_cast<size_t>(it - delta.begin());
+                best_candidate = c;
+            }
+        }
+        // ignore improvements within rounding error
+        if (best_candidate == n_ || best_delta > -1e-12 * cost()) return false;
+        medoids_[best_medoid] = static_cast<ptrdiff_t>(best_candidate);
+        update_nearest(dist);
+        return true;
+    }
+
+    size_t n_;
+    size_t k_;
+    std::vector<ptrdiff_t> nearest_;
+    std::vector<double> d_nearest_;
+    std::vector<double> d_second_;
+    std::vector<ptrdiff_t> labels_;
+    std::vector<ptrdiff_t> medoids_;
+};
+
+// Precompute distances, then run FastPAM;
+// the matrix needs n(n-1)/2 doubles.
+template <class T, class Metric=Euclidean> inline
+FastPAM fastpam(const T& points, ptrdiff_t k, int max_iteration=100, Metric metric=Metric{}) {
+    return FastPAM(pdist(as_matrix(points), metric), k, max_iteration);
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// CLARA and CLARANS: k-medoids for large n without the full distance matrix
+
+namespace detail {
+
+// Label each point with its nearest medoid; returns total distance
+template <class Metric> inline
+double assign_medoids(const Matrix<double>& points, const std::vector<ptrdiff_t>& medoids,
+                      Metric metric, size_t begin_, size_t end_, ptrdiff_t* labels) {
+    const size_t dim = points.ncol();
+    double cost = 0.0;
+    for (size_t o=begin_; o<end_; ++o) {
+        double best = std::numeric_limits<double>::max();
+        ptrdiff_t label = 0;
+        for (size_t m=0; m<medoids.size(); ++m) {
+            const double d = metric(points.row(o).data(), points.row(static_cast<size_t>(medoids[m])).data(), dim);
+            if (d < best) {
+                best = d;
+                label = static_cast<ptrdiff_t>(m);
+            }
+        }
+        if (labels) labels[o] = label;
+        cost += best;
+    }
+    return cost;
+}
+
+// Keep the result with the lowest cost; ties go to the earlier run
+struct MedoidRun {
+    std::vector<ptrdiff_t> medoids;
+    double cost = std::numeric_limits<double>::max();
+};
+
+inline const MedoidRun& best_run(const std::vector<MedoidRun>& runs) {
+    return *std::min_element(runs.begin(), runs.end(),
+        [](const MedoidRun& a, const MedoidRun& b) {return a.cost < b.cost;});
+}
+
+} // namespace detail
+
+// CLARA (Kaufman and Rousseeuw 1990): FastPAM on random subsamples,
+// keeping the medoids with the lowest cost on the full data.
+template <class Metric=Euclidean>
+class CLARA {
+  public:
+    // sample_size <= 0 means 40 + 2k
+    template <class Points, class URBG>
+    CLARA(const Points& points, ptrdiff_t k, URBG&& engine,
+          int samples=5, ptrdiff_t sample_size=0, Metric metric=Metric{}) {
+        SerialPool serial;
+        run(serial, as_matrix(points), k, engine, samples, sample_size, metric);
+    }
+
+    // subsample runs in parallel
+    template <class Pool, class Points, class URBG>
+    CLARA(Pool& pool, const Points& points, ptrdiff_t k, URBG&& engine,
+          int samples=5, ptrdiff_t sample_size=0, Metric metric=Metric{}) {
+        run(pool, as_matrix(points), k, engine, samples, sample_size, metric);
+    }
+
+    const auto& labels() const noexcept {return labels_;}
+    const auto& medoids() const noexcept {return medoids_;}
+    double cost() const noexcept {return cost_;}
+
+  private:
+    template <class Pool, class URBG>
+    void run(Pool& pool, const Matrix<double>& points, ptrdiff_t k, URBG& engine,
+             int samples, ptrdiff_t sample_size, Metric metric) {
+        const auto n = static_cast<ptrdiff_t>(points.nrow());
+        if (sample_size <= 0) sample_size = 40 + 2 * k;
+        sample_size = std::min(sample_size, n);
+        std::vector<std::vector<size_t>> subsamples;
+        for (int i=0; i<samples; ++i) {
+            const auto drawn = wtl::sample(n, sample_size, engine);
+            std::vector<size_t> indices(drawn.begin(), drawn.end());
+            std::sort(indices.begin(), indices.end());
+            subsamples.push_back(std::move(indices));
+        }
+        std::vector<detail::MedoidRun> runs(subsamples.size());
+        auto task = [&](size_t i) {
+            const auto& indices = subsamples[i];
+            Matrix<double> sub(indices.size(), points.ncol());
+            for (size_t r=0; r<indices.size(); ++r) {
+                std::copy(points.row(indices[r]).begin(), points.row(indices[r]).end(), sub.row(r).begin());
+            }
+            const FastPAM fit(pdist(sub, metric), k);
+            for (const auto m: fit.medoids()) {
+                runs[i].medoids.push_back(static_cast<ptrdiff_t>(indices[static_cast<size_t>(m)]));
+            }
+            runs[i].cost = detail::assign_medoids(points, runs[i].medoids, metric, 0u, points.nrow(), nullptr);
+        };
+        wtl::parallel_for(pool, size_t{0u}, runs.size(), size_t{1u}, task);
+        const auto& best = detail::best_run(runs);
+        medoids_ = best.medoids;
+        labels_.resize(points.nrow());
+        cost_ = detail::assign_medoids(points, medoids_, metric, 0u, points.nrow(), labels_.data());
+    }
+
+    std::vector<ptrdiff_t> labels_;
+    std::vector<ptrdiff_t> medoids_;
+    double cost_ = 0.0;
+};
+
+// CLARANS (Ng and Han 2002): randomized swap search on the full data.
+// Each of num_local restarts tries random (medoid, non-medoid) swaps and
+// stops after max_neighbor consecutive failures. A swap is evaluated in
+// O(n) distance calls using the nearest and second-nearest medoids.
+// Throws std::invalid_argument unless 1 <= k <= n and num_local >= 1.
+template <class Metric=Euclidean>
+class CLARANS {
+  public:
+    template <class Points, class URBG>
+    CLARANS(const Points& points, ptrdiff_t k, URBG&& engine,
+            int num_local=2, int max_neighbor=250, Metric metric=Metric{}) {
+        SerialPool serial;
+        run(serial, as_matrix(points), k, engine, num_local, max_neighbor, metric);
+    }
+
+    // restarts run in parallel with engines seeded from `engine`
+    template <class Pool, class Points, class URBG>
+    CLARANS(Pool& pool, const Points& points, ptrdiff_t k, URBG&& engine,
+            int num_local=2, int max_neighbor=250, Metric metric=Metric{}) {
+        run(pool, as_matrix(points), k, engine, num_local, max_neighbor, metric);
+    }
+
+    const auto& labels() const noexcept {return labels_;}
+    const auto& medoids() const noexcept {return medoids_;}
+    double cost() const noexcept {return cost_;}
+
+  private:
+    template <class Pool, class URBG>
+    void run(Pool& pool, const Matrix<double>& points, ptrdiff_t k, URBG& engine,
+             int num_local, int max_neighbor, Metric metric) {
+        if (k < 1 || static_cast<size_t>(k) > points.nrow()) {
+            throw std::invalid_argument("k must be in [1, n] in CLARANS");
+        }
+        if (num_local < 1) throw std::invalid_argument("num_local must be positive in CLARANS");
+        std::vector<uint64_t> seeds;
+        for (int i=0; i<num_local; ++i) {seeds.push_back(static_cast<uint64_t>(engine()));}
+        std::vector<detail::MedoidRun> runs(seeds.size());
+        auto task = [&](size_t i) {
+            std::mt19937_64 local_engine(seeds[i]);
+            runs[i] = local_search(points, k, local_engine, max_neighbor, metric);
+        };
+        wtl::parallel_for(pool, size_t{0u}, runs.size(), size_t{1u}, task);
+        medoids_ = detail::best_run(runs).medoids;
+        labels_.resize(points.nrow());
+        cost_ = detail::assign_medoids(points, medoids_, metric, 0u, points.nrow(), labels_.data());
+    }
+
+    static detail::MedoidRun
+    local_search(const Matrix<double>& points, ptrdiff_t k, std::mt19937_64& engine, int max_neighbor, Metric metric) {
+        const size_t n = points.nrow();
+        const size_t dim = points.ncol();
+        const auto distance = [&points, &metric, dim](size_t i, size_t j) {
+            return metric(points.row(i).data(), points.row(j).data(), dim);
+        };
+        const auto drawn = wtl::sample(static_cast<ptrdiff_t>(n), k, engine);
+        detail::MedoidRun current;
+        current.medoids.assign(drawn.begin(), drawn.end());
+        std::sort(current.medoids.begin(), current.medoids.end());
+        std::vector<bool> is_medoid(n);
+        std::vector<size_t> nearest(n);
+        std::vector<double> d_nearest(n);
+        std::vector<double> d_second(n);
+        const auto update = [&]() {
+            std::fill(is_medoid.begin(), is_medoid.end(), false);
+            current.cost = 0.0;
+            for (const auto m: current.medoids) {is_medoid[static_cast<size_t>(m)] = true;}
+            for (size_t o=0; o<n; ++o) {
+                double d1 = std::numeric_limits<double>::max();
+                double d2 = d1;
+                for (size_t m=0; m<current.medoids.size(); ++m) {
+                    const double d = distance(o, static_cast<size_t>(current.medoids[m]));
+                    if (d < d1) {
+                        d2 = d1;
+                        d1 = d;
+                        nearest[o] = m;
+                    } else if (d < d2) {
+                        d2 = d;
+                    }
+                }
+                d_nearest[o] = d1;
+                d_second[o] = d2;
+                current.cost += d1;
+            }
+        };
+        update();
+        std::uniform_int_distribution<size_t> pick_medoid(0u, current.medoids.size() - 1u);
+        std::uniform_int_distribution<size_t> pick_point(0u, n - 1u);
+        for (int failures=0; failures<max_neighbor && n > current.medoids.size();) {
+            const size_t m = pick_medoid(engine);
+            size_t c = pick_point(engine);
+            while (is_medoid[c]) {c = pick_point(engine);}
+            double delta = 0.0;
+            for (size_t o=0; o<n; ++o) {
+                const double d_oc = distance(o, c);
+                const double d_other = (nearest[o] == m) ? d_second[o] : d_nearest[o];
+                delta += std::min(d_oc, d_other) - d_nearest[o];
+            }
+            if (delta < -1e-12 * current.cost) {
+                current.medoids[m] = static_cast<ptrdiff_t>(c);
+                update();
+                failures = 0;
+            } else {
+                ++failures;
+            }
+        }
+        return current;
+    }
+
+    std::vector<ptrdiff_t> labels_;
+    std::vector<ptrdiff_t> medoids_;
+    double cost_ = 0.0;
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// k-means
+
+namespace detail {
+
+// Sum of fn(begin, end) over a partition of [0, n)
+template <class Pool, class Fn> inline
+auto sum_chunks(Pool& pool, size_t n, Fn& fn) {
+    using result_t = decltype(fn(size_t{}, size_t{}));
+    return wtl::detail::reduce_chunks(pool, n, result_t{}, fn, std::plus<result_t>{});
+}
+
+// Label points[begin_, end_) with the nearest center and store the
+// squared distance; returns the number of changed labels
+inline size_t assign_centers(const Matrix<double>& points, const Matrix<double>& centers,
+                             size_t begin_, size_t end_, ptrdiff_t* labels, double* d2) {
+    const size_t dim = points.ncol();
+    const SquaredEuclidean metric;
+    size_t changed = 0u;
+    for (size_t o=begin_; o<end_; ++o) {
+        double best = std::numeric_limits<double>::max();
+        ptrdiff_t label = 0;
+        for (size_t c=0; c<centers.nrow(); ++c) {
+            const double d = metric(points.row(o).data(), centers.row(c).data(), dim);
+            if (d < best) {
+                best = d;
+                label = static_cast<ptrdiff_t>(c);
+            }
+        }
+        changed += (labels[o] != label);
+        labels[o] = label;
+        d2[o] = best;
+    }
+    return changed;
+}
+
+// k-means++ seeding (Arthur and Vassilvitskii 2007): each center is drawn
+// with probability proportional to the squared distance to the nearest
+// center so far; d2 is left holding those distances.
+template <class Pool, class URBG> inline
+Matrix<double> kmeanspp(Pool& pool, const Matrix<double>& points, size_t k, URBG& engine,
+                        std::vector<double>* d2) {
+    const size_t n = points.nrow();
+    const size_t dim = points.ncol();
+    Matrix<double> centers(k, dim);
+    d2->assign(n, std::numeric_limits<double>::max());
+    std::uniform_int_distribution<size_t> uniform(0u, n - 1u);
+    size_t chosen = uniform(engine);
+    for (size_t c=0; c<k; ++c) {
+        if (c > 0u) {
+            const double total = std::accumulate(d2->begin(), d2->end(), 0.0);
+            if (total > 0.0) {
+                double r = std::uniform_real_distribution<double>(0.0, total)(engine);
+                // rounding can leave r >= 0 after the loop; fall back to the
+                // last point with d2 > 0, which is never an existing center
+                for (size_t o=0; o<n; ++o) {
+                    if ((*d2)[o] <= 0.0) continue;
+                    chosen = o;
+                    r -= (*d2)[o];
+                    if (r < 0.0) break;
+                }
+            } else {
+                chosen = uniform(engine);
+            }
+        }
+        std::copy(points.row(chosen).begin(), points.row(chosen).end(), centers.row(c).begin());
+        const auto center = centers.row(c).data();
+        auto update = [&points, d2, center, dim](size_t o) {
+            const SquaredEuclidean metric;
+            (*d2)[o] = std::min((*d2)[o], metric(points.row(o).data(), center, dim));
+        };
+        wtl::parallel_for(pool, size_t{0u}, n, size_t{256u}, update, Schedule::fixed);
+    }
+    return centers;
+}
+
+} // namespace detail
+
+// Lloyd's algorithm with k-means++ seeding.
+// The assignment step is parallel if a pool is given; the update step is
+// serial so that the result does not depend on the number of workers.
+// An emptied cluster takes over the point farthest from its center.
+class KMeans {
+  public:
+    template <class Points, class URBG>
+    KMeans(const Points& points, ptrdiff_t k, URBG&& engine, int max_iteration=100, double tolerance=0.0) {
+        SerialPool serial;
+        run(serial, as_matrix(points), k, engine, max_iteration, tolerance);
+    }
+
+    template <class Pool, class Points, class URBG>
+    KMeans(Pool& pool, const Points& points, ptrdiff_t k, URBG&& engine, int max_iteration=100, double tolerance=0.0) {
+        run(pool, as_matrix(points), k, engine, max_iteration, tolerance);
+    }
+
+    const auto& labels() const noexcept {return labels_;}
+    // k x dim
+    const Matrix<double>& centers() const noexcept {return centers_;}
+    // sum of squared distances to the assigned centers
+    double inertia() const noexcept {return inertia_;}
+    int iterations() const noexcept {return iterations_;}
+
+  private:
+    template <class Pool, class URBG>
+    void run(Pool& pool, const Matrix<double>& points, ptrdiff_t k, URBG& engine,
+             int max_iteration, double tolerance) {
+        const size_t n = points.nrow();
+        if (k < 1 || static_cast<size_t>(k) > n) throw std::invalid_argument("k must be in [1, n] in KMeans");
+        std::vector<double> d2;
+        centers_ = detail::kmeanspp(pool, points, static_cast<size_t>(k), engine, &d2);
+        labels_.assign(n, -1);
+        auto assign = [this, &points, &d2](size_t begin_, size_t end_) {
+            return detail::assign_centers(points, centers_, begin_, end_, labels_.data(), d2.data());
+        };
+        detail::sum_chunks(pool, n, assign);
+        for (iterations_=0; iterations_<max_iteration;) {
+            ++iterations_;
+            const double shift = update(points, &d2);
+            if (detail::sum_chunks(pool, n, assign) == 0u || shift <= tolerance) break;
+        }
+        inertia_ = std::accumulate(d2.begin(), d2.end(), 0.0);
+    }
+
+    // Move centers to the means; returns the largest squared shift
+    double update(const Matrix<double>& points, std::vector<double>* d2) {
+        const size_t k = centers_.nrow();
+        const size_t dim = centers_.ncol();
+        Matrix<double> sums(k, dim);
+        std::vector<size_t> counts(k);
+        for (size_t o=0; o<points.nrow(); ++o) {
+            const auto c = static_cast<size_t>(labels_[o]);
+            ++counts[c];
+            double* sum = sums.row(c).data();
+            const double* x = points.row(o).data();
+            for (size_t j=0; j<dim; ++j) {sum[j] += x[j];}
+        }
+        double shift = 0.0;
+        for (size_t c=0; c<k; ++c) {
+            if (counts[c] == 0u) {
+                const auto farthest = static_cast<size_t>(std::max_element(d2->begin(), d2->end()) - d2->begin());
+                (*d2)[farthest] = 0.0;
+                std::copy(points.row(farthest).begin(), points.row(farthest).end(), sums.row(c).begin());
+                counts[c] = 1u;
+            }
+            const double inv = 1.0 / static_cast<double>(counts[c]);
+            for (auto& x: sums.row(c)) {x *= inv;}
+            shift = std::max(shift, SquaredEuclidean{}(sums.row(c).data(), centers_.row(c).data(), dim));
+        }
+        centers_ = std::move(sums);
+        return shift;
+    }
+
+    std::vector<ptrdiff_t> labels_;
+    Matrix<double> centers_;
+    double inertia_ = 0.0;
+    int iterations_ = 0;
+};
+
+// Mini-batch k-means (Sculley 2010) on streamed batches.
+// Centers are seeded by k-means++ on the first batch; each point then
+// pulls its nearest center with a per-center learning rate 1/count.
+class MiniBatchKMeans {
+  public:
+    template <class URBG>
+    MiniBatchKMeans(ptrdiff_t k, URBG&& engine):
+      k_(k), engine_(static_cast<uint64_t>(engine())) {
+        if (k < 1) throw std::invalid_argument("k must be positive in MiniBatchKMeans");
+    }
+
+    template <class Points>
+    void partial_fit(const Points& batch) {
+        SerialPool serial;
+        fit(serial, as_matrix(batch));
+    }
+    template <class Pool, class Points>
+    void partial_fit(Pool& pool, const Points& batch) {
+        fit(pool, as_matrix(batch));
+    }
+
+    // nearest center for each point
+    template <class Points>
+    std::vector<ptrdiff_t> predict(const Points& points) const {
+        const auto& matrix = as_matrix(points);
+        std::vector<ptrdiff_t> labels(matrix.nrow(), -1);
+        std::vector<double> d2(matrix.nrow());
+        detail::assign_centers(matrix, centers_, 0u, matrix.nrow(), labels.data(), d2.data());
+        return labels;
+    }
+
+    // labels of the last batch
+    const auto& labels() const noexcept {return labels_;}
+    const Matrix<double>& centers() const noexcept {return centers_;}
+    // number of points assigned to each center so far
+    const std::vector<size_t>& counts() const noexcept {return counts_;}
+
+  private:
+    template <class Pool>
+    void fit(Pool& pool, const Matrix<double>& batch) {
+        const size_t n = batch.nrow();
+        std::vector<double> d2;
+        if (counts_.empty()) {
+            if (n < static_cast<size_t>(k_)) throw std::invalid_argument("first batch is smaller than k in MiniBatchKMeans");
+            centers_ = detail::kmeanspp(pool, batch, static_cast<size_t>(k_), engine_, &d2);
+            counts_.assign(static_cast<size_t>(k_), 0u);
+        } else if (batch.ncol() != centers_.ncol()) {
+            throw std::invalid_argument("dimension mismatch in MiniBatchKMeans::partial_fit()");
+        }
+        labels_.assign(n, -1);
+        d2.resize(n);
+        auto assign = [this, &batch, &d2](size_t begin_, size_t end_) {
+            return detail::assign_centers(batch, centers_, begin_, end_, labels_.data(), d2.data());
+        };
+        detail::sum_chunks(pool, n, assign);
+        const size_t dim = batch.ncol();
+        for (size_t o=0; o<n; ++o) {
+            const auto c = static_cast<size_t>(labels_[o]);
+            const double eta = 1.0 / static_cast<double>(++counts_[c]);
+            double* center = centers_.row(c).data();
+            const double* x = batch.row(o).data();
+            for (size_t j=0; j<dim; ++j) {center[j] += eta * (x[j] - center[j]);}
+        }
+    }
+
+    ptrdiff_t k_;
+    std::mt19937_64 engine_;
+    std::vector<ptrdiff_t> labels_;
+    Matrix<double> centers_;
+    std::vector<size_t> counts_;
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// neighbor search
+
+struct Neighbor {
+    ptrdiff_t index;
+    double distance;
+};
+
+inline bool operator<(const Neighbor& lhs, const Neighbor& rhs) noexcept {
+    return (lhs.distance < rhs.distance) || (lhs.distance == rhs.distance && lhs.index < rhs.index);
+}
+
+// Ball tree for exact k-NN and radius queries.
+// Metric must satisfy the triangle inequality (not SquaredEuclidean).
+// Points are copied in tree order; results refer to the original indices
+// and are sorted by (distance, index).
+template <class Metric=Euclidean>
+class BallTree {
+    static_assert(detail::is_metric<Metric>::value, "BallTree requires the triangle inequality");
+  public:
+    template <class Points>
+    explicit BallTree(const Points& points, Metric metric=Metric{}, size_t leaf_size=32u):
+      metric_(metric), leaf_size_(std::max<size_t>(leaf_size, 1u)) {
+        const auto& matrix = as_matrix(points);
+        dim_ = matrix.ncol();
+        std::vector<size_t> order(matrix.nrow());
+        std::iota(order.begin(), order.end(), size_t{0u});
+        if (!order.empty()) build(matrix, &order, 0u, order.size());
+        points_ = Matrix<double>(order.size(), dim_);
+        indices_.reserve(order.size());
+        for (size_t i=0; i<order.size(); ++i) {
+            std::copy(matrix.row(order[i]).begin(), matrix.row(order[i]).end(), points_.row(i).begin());
+            indices_.push_back(static_cast<ptrdiff_t>(order[i]));
+        }
+    }
+
+    // k nearest neighbors of query[0, dim)
+    std::vector<Neighbor> knn(const double* query, size_t k) const {
+        std::vector<Neighbor> heap;
+        if (k == 0u || nodes_.empty()) return heap;
+        heap.reserve(k + 1u);
+        search_knn(0u, query, distance_to_center(0u, query), k, &heap);
+        std::sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+
+    // all neighbors within distance r (inclusive)
+    std::vector<Neighbor> radius(const double* query, double r) const {
+        std::vector<Neighbor> out;
+        if (!nodes_.empty()) search_radius(0u, query, distance_to_center(0u, query), r, &out);
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    // one query per row of queries
+    template <class Points>
+    std::vector<std::vector<Neighbor>> knn_batch(const Points& queries, size_t k) const {
+        SerialPool serial;
+        return batch(serial, as_matrix(queries), [this, k](const double* q) {return knn(q, k);});
+    }
+    template <class Pool, class Points>
+    std::vector<std::vector<Neighbor>> knn_batch(Pool& pool, const Points& queries, size_t k) const {
+        return batch(pool, as_matrix(queries), [this, k](const double* q) {return knn(q, k);});
+    }
+    template <class Points>
+    std::vector<std::vector<Neighbor>> radius_batch(const Points& queries, double r) const {
+        SerialPool serial;
+        return batch(serial, as_matrix(queries), [this, r](const double* q) {return radius(q, r);});
+    }
+    template <class Pool, class Points>
+    std::vector<std::vector<Neighbor>> radius_batch(Pool& pool, const Points& queries, double r) const {
+        return batch(pool, as_matrix(queries), [this, r](const double* q) {return radius(q, r);});
+    }
+
+    size_t size() const noexcept {return indices_.size();}
+    size_t dim() const noexcept {return dim_;}
+
+  private:
+    // [begin_, end_) of the tree-ordered points; children are 0 for leaves
+    struct Node {
+        size_t begin_;
+        size_t end_;
+        size_t left;
+        size_t right;
+        double radius;
+    };
+
+    size_t build(const Matrix<double>& matrix, std::vector<size_t>* order, size_t begin_, size_t end_) {
+        const size_t id = nodes_.size();
+        nodes_.push_back(Node{begin_, end_, 0u, 0u, 0.0});
+        centers_.resize(centers_.size() + dim_);
+        double* center = centers_.data() + id * dim_;
+        std::vector<double> lower(dim_, std::numeric_limits<double>::max());
+        std::vector<double> upper(dim_, std::numeric_limits<double>::lowest());
+        for (size_t i=begin_; i<end_; ++i) {
+            const double* x = matrix.row((*order)[i]).data();
+            for (size_t j=0; j<dim_; ++j) {
+                center[j] += x[j];
+                lower[j] = std::min(lower[j], x[j]);
+                upper[j] = std::max(upper[j], x[j]);
+            }
+        }
+        const double inv = 1.0 / static_cast<double>(end_ - begin_);
+        for (size_t j=0; j<dim_; ++j) {center[j] *= inv;}
+        double radius = 0.0;
+        for (size_t i=begin_; i<end_; ++i) {
+            radius = std::max(radius, metric_(matrix.row((*order)[i]).data(), center, dim_));
+        }
+        nodes_[id].radius = radius;
+        if (end_ - begin_ <= leaf_size_) return id;
+        // split at the median of the widest coordinate
+        size_t axis = 0u;
+        for (size_t j=1; j<dim_; ++j) {
+            if (upper[j] - lower[j] > upper[axis] - lower[axis]) axis = j;
+        }
+        const size_t mid = begin_ + (end_ - begin_) / 2u;
+        std::nth_element(order->begin() + static_cast<ptrdiff_t>(begin_),
+                         order->begin() + static_cast<ptrdiff_t>(mid),
+                         order->begin() + static_cast<ptrdiff_t>(end_),
+                         [&matrix, axis](size_t a, size_t b) {return matrix(a, axis) < matrix(b, axis);});
+        const size_t left = build(matrix, order, begin_, mid);
+        const size_t right = build(matrix, order, mid, end_);
+        nodes_[id].left = left;
+        nodes_[id].right = right;
+        return id;
+    }
+
+    double distance_to_center(size_t node, const double* query) const {
+        return metric_(query, centers_.data() + node * dim_, dim_);
+    }
+
+    // d is the distance from query to the center of node
+    void search_knn(size_t node, const double* query, double d, size_t k, std::vector<Neighbor>* heap) const {
+        const Node& nd = nodes_[node];
+        if (heap->size() == k && d - nd.radius > heap->front().distance) return;
+        if (nd.left == 0u) {
+            for (size_t i=nd.begin_; i<nd.end_; ++i) {
+                const Neighbor candidate{indices_[i], metric_(query, points_.row(i).data(), dim_)};
+                if (heap->size() < k) {
+                    heap->push_back(candidate);
+                    std::push_heap(heap->begin(), heap->end());
+                } else if (candidate < heap->front()) {
+                    std::pop_heap(heap->begin(), heap->end());
+                    heap->back() = candidate;
+                    std::push_heap(heap->begin(), heap->end());
+                }
+            }
+            return;
+        }
+        const double dl = distance_to_center(nd.left, query);
+        const double dr = distance_to_center(nd.right, query);
+        if (dl <= dr) {
+            search_knn(nd.left, query, dl, k, heap);
+            search_knn(nd.right, query, dr, k, heap);
+        } else {
+            search_knn(nd.right, query, dr, k, heap);
+            search_knn(nd.left, query, dl, k, heap);
+        }
+    }
+
+    void search_radius(size_t node, const double* query, double d, double r, std::vector<Neighbor>* out) const {
+        const Node& nd = nodes_[node];
+        if (d - nd.radius > r) return;
+        if (nd.left == 0u) {
+            for (size_t i=nd.begin_; i<nd.end_; ++i) {
+                const double di = metric_(query, points_.row(i).data(), dim_);
+                if (di <= r) out->push_back(Neighbor{indices_[i], di});
+            }
+            return;
+        }
+        search_radius(nd.left, query, distance_to_center(nd.left, query), r, out);
+        search_radius(nd.right, query, distance_to_center(nd.right, query), r, out);
+    }
+
+    template <class Pool, class Query>
+    std::vector<std::vector<Neighbor>> batch(Pool& pool, const Matrix<double>& queries, Query query) const {
+        if (queries.nrow() > 0u && queries.ncol() != dim_) {
+            throw std::invalid_argument("dimension mismatch in BallTree query");
+        }
+        std::vector<std::vector<Neighbor>> out(queries.nrow());
+        wtl::parallel_for(pool, size_t{0u}, queries.nrow(), size_t{1u}, [&out, &queries, &query](size_t i) {
+            out[i] = query(queries.row(i).data());
+        });
+        return out;
+    }
+
+    Metric metric_;
+    size_t leaf_size_;
+    size_t dim_ = 0u;
+    Matrix<double> points_;
+    std::vector<ptrdiff_t> indices_;
+    std::vector<Node> nodes_;
+    std::vector<double> centers_;
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// hierarchical clustering
+
+enum class Linkage {single, complete, average, ward};
+
+namespace detail {
+
+class DisjointSet {
+  public:
+    explicit DisjointSet(size_t n): parent_(n) {
+        std::iota(parent_.begin(), parent_.end(), size_t{0u});
+    }
+    size_t find(size_t x) noexcept {
+        while (parent_[x] != x) {
+            parent_[x] = parent_[parent_[x]];
+            x = parent_[x];
+        }
+        return x;
+    }
+    // root of the merged set is the root of y
+    size_t unite(size_t x, size_t y) noexcept {
+        x = find(x);
+        y = find(y);
+        parent_[x] = y;
+        return y;
+    }
+  private:
+    std::vector<size_t> parent_;
+};
+
+// Lance-Williams update of d(k, x+y); Ward works on distances, not squares
+inline double lance_williams(Linkage method, double d_kx, double d_ky, double d_xy,
+                             double n_x, double n_y, double n_k) noexcept {
+    switch (method) {
+      case Linkage::single: return std::min(d_kx, d_ky);
+      case Linkage::complete: return std::max(d_kx, d_ky);
+      case Linkage::average: return (n_x * d_kx + n_y * d_ky) / (n_x + n_y);
+      case Linkage::ward: break;
+    }
+    const double t = 1.0 / (n_x + n_y + n_k);
+    return std::sqrt(std::max(0.0,
+      (n_x + n_k) * t * d_kx * d_kx + (n_y + n_k) * t * d_ky * d_ky - n_k * t * d_xy * d_xy));
+}
+
+} // namespace detail
+
+// Agglomerative clustering by the nearest-neighbor chain algorithm,
+// O(n^2) time on a copy of the condensed matrix.
+// Returns the (n-1) x 4 linkage matrix of scipy.cluster.hierarchy.linkage:
+// row i merges clusters Z(i,0) and Z(i,1) at height Z(i,2) into cluster
+// n+i with Z(i,3) observations; ids < n are observations.
+inline Matrix<double> linkage(const DistanceMatrix& dist, Linkage method=Linkage::average) {
+    const size_t n = dist.n();
+    if (n < 2u) return Matrix<double>(0u, 4u);
+    DistanceMatrix d = dist;
+    std::vector<double> sizes(n, 1.0);
+    struct Merge {size_t x; size_t y; double height;};
+    std::vector<Merge> merges;
+    merges.reserve(n - 1u);
+    std::vector<size_t> chain;
+    chain.reserve(n);
+    for (size_t step=0; step<n-1u; ++step) {
+        if (chain.empty()) {
+            chain.push_back(static_cast<size_t>(std::find_if(sizes.begin(), sizes.end(),
+                [](double s) {return s > 0.0;}) - sizes.begin()));
+        }
+        size_t x = 0u, y = 0u;
+        double current = 0.0;
+        while (true) {
+            x = chain.back();
+            current = std::numeric_limits<double>::infinity();
+            if (chain.size() > 1u) {
+                y = chain[chain.size() - 2u];
+                current = d(x, y);
+            }
+            for (size_t i=0; i<n; ++i) {
+                if (sizes[i] == 0.0 || i == x) continue;
+                const double dxi = d(x, i);
+                if (dxi < current) {
+                    current = dxi;
+                    y = i;
+                }
+            }
+            if (chain.size() > 1u && y == chain[chain.size() - 2u]) break;
+            chain.push_back(y);
+        }
+        chain.resize(chain.size() - 2u);
+        if (x > y) std::swap(x, y);
+        merges.push_back(Merge{x, y, current});
+        const double nx = sizes[x];
+        const double ny = sizes[y];
+        sizes[x] = 0.0;
+        sizes[y] = nx + ny;
+        for (size_t i=0; i<n; ++i) {
+            if (sizes[i] == 0.0 || i == y) continue;
+            d.at(std::min(i, y), std::max(i, y)) =
+              detail::lance_williams(method, d(i, x), d(i, y), current, nx, ny, sizes[i]);
+        }
+    }
+    std::stable_sort(merges.begin(), merges.end(),
+        [](const Merge& a, const Merge& b) {return a.height < b.height;});
+    // relabel representatives to SciPy cluster ids
+    detail::DisjointSet sets(2u * n - 1u);
+    std::vector<double> counts(2u * n - 1u, 1.0);
+    Matrix<double> z(n - 1u, 4u);
+    for (size_t i=0; i<merges.size(); ++i) {
+        size_t a = sets.find(merges[i].x);
+        size_t b = sets.find(merges[i].y);
+        if (a > b) std::swap(a, b);
+        const size_t id = n + i;
+        sets.unite(a, id);
+        sets.unite(b, id);
+        counts[id] = counts[a] + counts[b];
+        z(i, 0u) = static_cast<double>(a);
+        z(i, 1u) = static_cast<double>(b);
+        z(i, 2u) = merges[i].height;
+        z(i, 3u) = counts[id];
+    }
+    return z;
+}
+
+// Convenience overload: pdist with Euclidean distances, as euclidean_distance()
+template <class Points> inline
+Matrix<double> linkage(const Points& points, Linkage method=Linkage::average) {
+    return linkage(pdist(as_matrix(points), Euclidean{}), method);
+}
+
+// Labels in [0, k) after applying the n-k lowest merges of a linkage
+// matrix; clusters are numbered in order of their first observation.
+inline std::vector<ptrdiff_t> cut_tree(const Matrix<double>& z, ptrdiff_t k) {
+    const size_t n = z.nrow() + 1u;
+    if (k < 1 || static_cast<size_t>(k) > n) throw std::invalid_argument("k must be in [1, n] in cut_tree()");
+    detail::DisjointSet sets(2u * n - 1u);
+    for (size_t i=0; i<n-static_cast<size_t>(k); ++i) {
+        sets.unite(static_cast<size_t>(z(i, 0u)), n + i);
+        sets.unite(static_cast<size_t>(z(i, 1u)), n + i);
+    }
+    std::vector<ptrdiff_t> labels(n);
+    std::vector<ptrdiff_t> label_of_root(2u * n - 1u, -1);
+    ptrdiff_t next = 0;
+    for (size_t i=0; i<n; ++i) {
+        auto& label = label_of_root[sets.find(i)];
+        if (label < 0) label = next++;
+        labels[i] = label;
+    }
+    return labels;
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// DBSCAN
+
+namespace detail {
+
+// Lock-free union-find: roots are linked from larger to smaller index by
+// compare-and-swap, so concurrent unite() calls are safe.
+class ConcurrentDisjointSet {
+  public:
+    explicit ConcurrentDisjointSet(size_t n): parent_(n) {
+        for (size_t i=0; i<n; ++i) {parent_[i].store(i, std::memory_order_relaxed);}
+    }
+    size_t find(size_t x) noexcept {
+        while (true) {
+            size_t p = parent_[x].load(std::memory_order_acquire);
+            if (p == x) return x;
+            const size_t gp = parent_[p].load(std::memory_order_acquire);
+            if (p != gp) parent_[x].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
+            x = gp;
+        }
+    }
+    void unite(size_t x, size_t y) noexcept {
+        while (true) {
+            x = find(x);
+            y = find(y);
+            if (x == y) return;
+            if (x < y) std::swap(x, y);
+            size_t expected = x;
+            if (parent_[x].compare_exchange_strong(expected, y, std::memory_order_acq_rel)) return;
+        }
+    }
+  private:
+    std::vector<std::atomic<size_t>> parent_;
+};
+
+// Uniform grid of cubic cells for fixed-radius queries in low dimensions.
+// Valid for metrics bounded below by every coordinate difference.
+class GridIndex {
+  public:
+    static constexpr size_t max_dim = 3u;
+    static constexpr int64_t axis_bits = 21;
+
+    GridIndex(const Matrix<double>& points, double radius):
+      dim_(points.ncol()), cell_(radius * (1.0 + 1e-9)),
+      lower_(dim_, std::numeric_limits<double>::max()) {
+        const size_t n = points.nrow();
+        std::vector<double> upper(dim_, std::numeric_limits<double>::lowest());
+        for (size_t i=0; i<n; ++i) {
+            for (size_t j=0; j<dim_; ++j) {
+                lower_[j] = std::min(lower_[j], points(i, j));
+                upper[j] = std::max(upper[j], points(i, j));
+            }
+        }
+        valid_ = (dim_ <= max_dim) && (cell_ > 0.0);
+        for (size_t j=0; j<dim_ && valid_; ++j) {
+            valid_ = ((upper[j] - lower_[j]) / cell_ < static_cast<double>((int64_t{1} << axis_bits) - 2));
+        }
+        if (!valid_) return;
+        std::vector<std::pair<uint64_t, size_t>> keyed(n);
+        for (size_t i=0; i<n; ++i) {keyed[i] = {key(points.row(i).data()), i};}
+        std::sort(keyed.begin(), keyed.end());
+        order_.resize(n);
+        for (size_t i=0; i<n; ++i) {
+            order_[i] = keyed[i].second;
+            if (i == 0u || keyed[i].first != keyed[i - 1u].first) {
+                cells_.emplace(keyed[i].first, std::make_pair(i, i));
+            }
+            ++cells_[keyed[i].first].second;
+        }
+    }
+
+    bool valid() const noexcept {return valid_;}
+
+    // fn(j) for each point j in the 3^dim cells around query
+    template <class Fn>
+    void for_each_candidate(const double* query, Fn fn) const {
+        int64_t center[max_dim] = {};
+        for (size_t j=0; j<dim_; ++j) {center[j] = coordinate(query[j], j);}
+        int64_t offset[max_dim] = {};
+        std::fill(offset, offset + dim_, -1);
+        while (true) {
+            uint64_t k = 0u;
+            bool inside = true;
+            for (size_t j=0; j<dim_; ++j) {
+                const int64_t c = center[j] + offset[j];
+                inside = inside && (c >= 0);
+                k = (k << axis_bits) | static_cast<uint64_t>(std::max(c, int64_t{0}));
+            }
+            if (inside) {
+                const auto it = cells_.find(k);
+                if (it != cells_.end()) {
+                    for (size_t i=it->second.first; i<it->second.second; ++i) {fn(order_[i]);}
+                }
+            }
+            size_t j = 0u;
+            while (j < dim_ && offset[j] == 1) {offset[j++] = -1;}
+            if (j == dim_) break;
+            ++offset[j];
+        }
+    }
+
+  private:
+    int64_t coordinate(double x, size_t j) const noexcept {
+        return static_cast<int64_t>(std::floor((x - lower_[j]) / cell_));
+    }
+    uint64_t key(const double* x) const noexcept {
+        uint64_t k = 0u;
+        for (size_t j=0; j<dim_; ++j) {
+            k = (k << axis_bits) | static_cast<uint64_t>(coordinate(x[j], j));
+        }
+        return k;
+    }
+
+    size_t dim_;
+    double cell_;
+    std::vector<double> lower_;
+    bool valid_ = false;
+    std::vector<size_t> order_;
+    std::unordered_map<uint64_t, std::pair<size_t, size_t>> cells_;
+};
+
+template <class Metric>
+struct is_coordinate_bounded: std::false_type {};
+template <>
+struct is_coordinate_bounded<Euclidean>: std::true_type {};
+template <>
+struct is_coordinate_bounded<Manhattan>: std::true_type {};
+
+} // namespace detail
+
+// DBSCAN (Ester et al. 1996) with the core-point criterion counting the
+// point itself. Neighbors are found with a uniform grid for Euclidean or
+// Manhattan metrics in up to 3 dimensions, or a BallTree otherwise;
+// distances without the triangle inequality (SquaredEuclidean) scan all
+// pairs.
+// Core points are found in parallel if a pool is given, and linked with a
+// concurrent union-find. Labels are numbered from 0 in order of the first
+// member as in PAM::labels(); noise is -1. A border point joins the
+// cluster of its lowest-index core neighbor.
+template <class Metric=Euclidean>
+class DBSCAN {
+  public:
+    template <class Points>
+    DBSCAN(const Points& points, double eps, size_t min_points, Metric metric=Metric{}) {
+        SerialPool serial;
+        run(serial, as_matrix(points), eps, min_points, metric);
+    }
+
+    template <class Pool, class Points>
+    DBSCAN(Pool& pool, const Points& points, double eps, size_t min_points, Metric metric=Metric{}) {
+        run(pool, as_matrix(points), eps, min_points, metric);
+    }
+
+    const auto& labels() const noexcept {return labels_;}
+    const std::vector<bool>& core() const noexcept {return core_;}
+    ptrdiff_t num_clusters() const noexcept {return num_clusters_;}
+
+  private:
+    template <class Pool>
+    void run(Pool& pool, const Matrix<double>& points, double eps, size_t min_points, Metric metric) {
+        const size_t dim = points.ncol();
+        const auto within = [&points, eps, metric, dim](size_t i, size_t j) {
+            return metric(points.row(i).data(), points.row(j).data(), dim) <= eps;
+        };
+        const size_t n = points.nrow();
+        if constexpr (!detail::is_metric<Metric>::value) {
+            run(pool, n, min_points, [n, &within](size_t i, auto fn) {
+                for (size_t j=0; j<n; ++j) {
+                    if (within(i, j)) fn(j);
+                }
+            });
+        } else {
+            if (detail::is_coordinate_bounded<Metric>::value && dim <= detail::GridIndex::max_dim) {
+                const detail::GridIndex grid(points, eps);
+                if (grid.valid()) {
+                    run(pool, n, min_points, [&grid, &points, &within](size_t i, auto fn) {
+                        grid.for_each_candidate(points.row(i).data(), [i, &within, &fn](size_t j) {
+                            if (within(i, j)) fn(j);
+                        });
+                    });
+                    return;
+                }
+            }
+            const BallTree<Metric> tree(points, metric);
+            run(pool, n, min_points, [&tree, &points, eps](size_t i, auto fn) {
+                for (const auto& neighbor: tree.radius(points.row(i).data(), eps)) {
+                    fn(static_cast<size_t>(neighbor.index));
+                }
+            });
+        }
+    }
+
+    // neighbors(i, fn) calls fn(j) for each j within eps of i, including i
+    template <class Pool, class Neighbors>
+    void run(Pool& pool, size_t n, size_t min_points, Neighbors neighbors) {
+        std::vector<char> is_core(n);
+        wtl::parallel_for(pool, size_t{0u}, n, size_t{16u}, [&is_core, &neighbors, min_points](size_t i) {
+            size_t count = 0u;
+            neighbors(i, [&count](size_t) {++count;});
+            is_core[i] = (count >= min_points);
+        });
+        detail::ConcurrentDisjointSet sets(n);
+        std::vector<size_t> border(n, n);
+        wtl::parallel_for(pool, size_t{0u}, n, size_t{16u}, [&is_core, &neighbors, &sets, &border](size_t i) {
+            if (is_core[i]) {
+                neighbors(i, [i, &is_core, &sets](size_t j) {
+                    if (j < i && is_core[j]) sets.unite(i, j);
+                });
+            } else {
+                neighbors(i, [&is_core, &border, i](size_t j) {
+                    if (is_core[j]) border[i] = std::min(border[i], j);
+                });
+            }
+        });
+        labels_.assign(n, -1);
+        core_.assign(is_core.begin(), is_core.end());
+        std::vector<ptrdiff_t> label_of_root(n, -1);
+        num_clusters_ = 0;
+        for (size_t i=0; i<n; ++i) {
+            const size_t anchor = is_core[i] ? i : border[i];
+            if (anchor == n) continue;
+            auto& label = label_of_root[sets.find(anchor)];
+            if (label < 0) label = num_clusters_++;
+            labels_[i] = label;
+        }
+    }
+
+    std::vector<ptrdiff_t> labels_;
+    std::vector<bool> core_;
+    ptrdiff_t num_clusters_ = 0;
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// validity indices
+//
+// Labels are in [0, k); points with negative labels (DBSCAN noise) are
+// ignored. Overloads taking a DistanceMatrix reuse it instead of
+// recomputing distances.
+
+namespace detail {
+
+inline size_t num_labels(const std::vector<ptrdiff_t>& labels) {
+    ptrdiff_t k = 0;
+    for (const auto x: labels) {k = std::max(k, x + 1);}
+    return static_cast<size_t>(k);
+}
+
+// silhouette widths of [begin_, end_) given dist(i, j)
+template <class Distance> inline
+void silhouette_range(Distance& dist, const std::vector<ptrdiff_t>& labels, const std::vector<double>& sizes,
+                        size_t begin_, size_t end_, double* out) {
+    const size_t n = labels.size();
+    std::vector<double> sums(sizes.size());
+    for (size_t i=begin_; i<end_; ++i) {
+        out[i] = 0.0;
+        if (labels[i] < 0) continue;
+        const auto own = static_cast<size_t>(labels[i]);
+        if (sizes[own] < 2.0) continue;
+        std::fill(sums.begin(), sums.end(), 0.0);
+        for (size_t j=0; j<n; ++j) {
+            if (labels[j] >= 0) sums[static_cast<size_t>(labels[j])] += dist(i, j);
+        }
+        const double a = sums[own] / (sizes[own] - 1.0);
+        double b = std::numeric_limits<double>::infinity();
+        for (size_t c=0; c<sums.size(); ++c) {
+            if (c != own && sizes[c] > 0.0) b = std::min(b, sums[c] / sizes[c]);
+        }
+        if (std::isfinite(b)) out[i] = (b - a) / std::max(a, b);
+    }
+}
+
+template <class Pool, class Distance> inline
+std::vector<double> silhouette_samples(Pool& pool, Distance dist, const std::vector<ptrdiff_t>& labels) {
+    std::vector<double> sizes(num_labels(labels));
+    for (const auto x: labels) {if (x >= 0) ++sizes[static_cast<size_t>(x)];}
+    const size_t n = labels.size();
+    const size_t block = 64u;
+    std::vector<double> out(n);
+    auto task = [&dist, &labels, &sizes, &out, block, n](size_t b) {
+        const size_t ib = b * block;
+        silhouette_range(dist, labels, sizes, ib, std::min(ib + block, n), out.data());
+    };
+    wtl::parallel_for(pool, size_t{0u}, (n + block - 1u) / block, size_t{1u}, task);
+    return out;
+}
+
+inline double mean_labelled(const std::vector<double>& values, const std::vector<ptrdiff_t>& labels) {
+    double sum = 0.0;
+    size_t count = 0u;
+    for (size_t i=0; i<values.size(); ++i) {
+        if (labels[i] < 0) continue;
+        sum += values[i];
+        ++count;
+    }
+    return count ? sum / static_cast<double>(count) : 0.0;
+}
+
+template <class Pool> inline
+double within_dispersion(Pool& pool, const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    std::vector<double> sizes(num_labels(labels));
+    for (const auto x: labels) {if (x >= 0) ++sizes[static_cast<size_t>(x)];}
+    auto task = [&dist, &labels, &sizes](size_t begin_, size_t end_) {
+        double sum = 0.0;
+        for (size_t i=begin_; i<end_; ++i) {
+            if (labels[i] < 0) continue;
+            double row = 0.0;
+            for (size_t j=i+1u; j<labels.size(); ++j) {
+                const double d = dist(i, j);
+                row += (labels[j] == labels[i]) ? d * d : 0.0;
+            }
+            sum += row / sizes[static_cast<size_t>(labels[i])];
+        }
+        return sum;
+    };
+    return sum_chunks(pool, labels.size(), task);
+}
+
+// cluster means of contiguous points
+inline Matrix<double> centroids(const Matrix<double>& points, const std::vector<ptrdiff_t>& labels,
+                                std::vector<double>* sizes) {
+    const size_t dim = points.ncol();
+    sizes->assign(num_labels(labels), 0.0);
+    Matrix<double> out(sizes->size(), dim);
+    for (size_t i=0; i<points.nrow(); ++i) {
+        if (labels[i] < 0) continue;
+        const auto c = static_cast<size_t>(labels[i]);
+        ++(*sizes)[c];
+        for (size_t j=0; j<dim; ++j) {out(c, j) += points(i, j);}
+    }
+    for (size_t c=0; c<out.nrow(); ++c) {
+        if ((*sizes)[c] == 0.0) continue;
+        const double inv = 1.0 / (*sizes)[c];
+        for (auto& x: out.row(c)) {x *= inv;}
+    }
+    return out;
+}
+
+} // namespace detail
+
+// Silhouette width (Rousseeuw 1987) of each point; 0 for singletons
+inline std::vector<double>
+silhouette_samples(const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    SerialPool serial;
+    return detail::silhouette_samples(serial, [&dist](size_t i, size_t j) {return dist(i, j);}, labels);
+}
+
+template <class Pool> inline
+std::vector<double>
+silhouette_samples(Pool& pool, const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    return detail::silhouette_samples(pool, [&dist](size_t i, size_t j) {return dist(i, j);}, labels);
+}
+
+// Euclidean distances computed on the fly, without O(n^2) memory
+template <class Pool, class Points> inline
+std::vector<double>
+silhouette_samples(Pool& pool, const Points& points, const std::vector<ptrdiff_t>& labels) {
+    const auto& matrix = as_matrix(points);
+    const size_t dim = matrix.ncol();
+    const auto dist = [&matrix, dim](size_t i, size_t j) {
+        return Euclidean{}(matrix.row(i).data(), matrix.row(j).data(), dim);
+    };
+    return detail::silhouette_samples(pool, dist, labels);
+}
+
+// Mean silhouette width
+inline double silhouette(const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    return detail::mean_labelled(silhouette_samples(dist, labels), labels);
+}
+
+template <class Pool, class Distances> inline
+double silhouette(Pool& pool, const Distances& dist, const std::vector<ptrdiff_t>& labels) {
+    return detail::mean_labelled(silhouette_samples(pool, dist, labels), labels);
+}
+
+// Pooled within-cluster dispersion W_k = sum_r D_r / (2 n_r) of
+// Tibshirani et al. (2001); equals the k-means inertia for Euclidean dist.
+inline double within_dispersion(const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    SerialPool serial;
+    return detail::within_dispersion(serial, dist, labels);
+}
+
+template <class Pool> inline
+double within_dispersion(Pool& pool, const DistanceMatrix& dist, const std::vector<ptrdiff_t>& labels) {
+    return detail::within_dispersion(pool, dist, labels);
+}
+
+// Davies-Bouldin index (lower is better) with Euclidean centroid distances;
+// O(n dim + k^2 dim), so no DistanceMatrix is needed.
+// Pairs of clusters with coincident centroids have no defined similarity
+// and are skipped, as in scikit-learn, instead of dividing by zero.
+template <class Points> inline
+double davies_bouldin(const Points& points, const std::vector<ptrdiff_t>& labels) {
+    const auto& matrix = as_matrix(points);
+    const size_t dim = matrix.ncol();
+    std::vector<double> sizes;
+    const auto centers = detail::centroids(matrix, labels, &sizes);
+    const size_t k = centers.nrow();
+    std::vector<double> scatter(k);
+    for (size_t i=0; i<matrix.nrow(); ++i) {
+        if (labels[i] < 0) continue;
+        const auto c = static_cast<size_t>(labels[i]);
+        scatter[c] += Euclidean{}(matrix.row(i).data(), centers.row(c).data(), dim);
+    }
+    double sum = 0.0;
+    size_t nonempty = 0u;
+    for (size_t c=0; c<k; ++c) {
+        if (sizes[c] == 0.0) continue;
+        scatter[c] /= sizes[c];
+    }
+    for (size_t c=0; c<k; ++c) {
+        if (sizes[c] == 0.0) continue;
+        double worst = 0.0;
+        for (size_t other=0; other<k; ++other) {
+            if (other == c || sizes[other] == 0.0) continue;
+            const double separation = Euclidean{}(centers.row(c).data(), centers.row(other).data(), dim);
+            if (separation == 0.0) continue;
+            worst = std::max(worst, (scatter[c] + scatter[other]) / separation);
+        }
+        sum += worst;
+        ++nonempty;
+    }
+    return nonempty ? sum / static_cast<double>(nonempty) : 0.0;
+}
+
+struct KScore {
+    ptrdiff_t k;
+    double silhouette;
+    double within_dispersion;
+    double davies_bouldin;
+    std::vector<ptrdiff_t> labels;
+};
+
+// Cluster with each k concurrently and score the result.
+// cluster(dist, k) returns labels; Euclidean pdist is computed once.
+template <class Pool, class Points, class Cluster> inline
+std::vector<KScore>
+sweep_k(Pool& pool, const Points& points, const std::vector<ptrdiff_t>& ks, Cluster cluster) {
+    const auto& matrix = as_matrix(points);
+    const auto dist = pdist(pool, matrix, Euclidean{});
+    std::vector<KScore> out(ks.size());
+    auto task = [&](size_t i) {
+        auto labels = cluster(dist, ks[i]);
+        out[i].k = ks[i];
+        out[i].silhouette = silhouette(dist, labels);
+        out[i].within_dispersion = within_dispersion(dist, labels);
+        out[i].davies_bouldin = davies_bouldin(matrix, labels);
+        out[i].labels = std::move(labels);
+    };
+    wtl::parallel_for(pool, size_t{0u}, ks.size(), size_t{1u}, task);
+    return out;
+}
+
+// FastPAM for each k
+template <class Pool, class Points> inline
+std::vector<KScore>
+sweep_k(Pool& pool, const Points& points, const std::vector<ptrdiff_t>& ks) {
+    return sweep_k(pool, points, ks, [](const DistanceMatrix& dist, ptrdiff_t k) {
+        return FastPAM(dist, k).labels();
+    });
+}
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 }} // namespace wtl::cluster
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
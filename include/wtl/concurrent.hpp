@@ -9,18 +9,168 @@
 #include <chrono>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <memory>
 #include <type_traits>
+#include <atomic>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <utility>
+#include <new>
+#include <tuple>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <cctype>
+#include <cmath>
+
+#ifdef __linux__
+  #include <sched.h>
+  #include <pthread.h>
+#endif
 
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 namespace wtl {
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 
+namespace detail {
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+inline std::vector<int> parse_cpulist(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        if (item.empty() || !std::isdigit(static_cast<unsigned char>(item[0]))) continue;
+        const auto dash = item.find('-');
+        const int first = std::stoi(item.substr(0u, dash));
+        const int last = (dash == std::string::npos) ? first : std::stoi(item.substr(dash + 1u));
+        for (int cpu=first; cpu<=last; ++cpu) {cpus.push_back(cpu);}
+    }
+    return cpus;
+}
+
+inline std::string read_first_line(const std::string& path) {
+    std::ifstream ifs(path);
+    std::string line;
+    std::getline(ifs, line);
+    return line;
+}
+
+// CPU bandwidth limit of the cgroup as a number of CPUs; 0 if unlimited
+inline double cgroup_cpu_quota() {
+#ifdef __linux__
+    // cgroup v2: "<quota> <period>" or "max <period>" in cpu.max
+    std::string relative;
+    {
+        std::ifstream ifs("/proc/self/cgroup");
+        for (std::string line; std::getline(ifs, line);) {
+            if (line.rfind("0::", 0u) == 0u) relative = line.substr(3u);
+        }
+    }
+    for (const std::string& path: {"/sys/fs/cgroup" + relative + "/cpu.max", std::string("/sys/fs/cgroup/cpu.max")}) {
+        std::istringstream iss(read_first_line(path));
+        std::string quota;
+        double period = 0.0;
+        if (iss >> quota >> period) {
+            return (quota == "max" || period <= 0.0) ? 0.0 : std::stod(quota) / period;
+        }
+    }
+    // cgroup v1
+    const std::string quota = read_first_line("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    const std::string period = read_first_line("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    if (!quota.empty() && !period.empty() && quota[0] != '-') {
+        const double p = std::stod(period);
+        return (p > 0.0) ? std::stod(quota) / p : 0.0;
+    }
+#endif
+    return 0.0;
+}
+
+} // namespace detail
+
+// CPUs this process may run on: the sched_getaffinity() mask on Linux,
+// otherwise 0, ..., std::thread::hardware_concurrency() - 1
+inline std::vector<int> usable_cpus() {
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu=0; cpu<CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(static_cast<size_t>(cpu), &mask)) cpus.push_back(cpu);
+        }
+    }
+#endif
+    if (cpus.empty()) {
+        const auto n = static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u));
+        for (int cpu=0; cpu<n; ++cpu) {cpus.push_back(cpu);}
+    }
+    return cpus;
+}
+
+// usable CPUs grouped by NUMA node; a single group if unknown
+inline std::vector<std::vector<int>> numa_nodes() {
+    const auto usable = usable_cpus();
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    // node ids can be sparse, e.g., "0,2-3"
+    for (const int node: detail::parse_cpulist(detail::read_first_line("/sys/devices/system/node/online"))) {
+        const std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+        std::vector<int> cpus;
+        for (const int cpu: detail::parse_cpulist(detail::read_first_line(path))) {
+            if (std::find(usable.begin(), usable.end(), cpu) != usable.end()) cpus.push_back(cpu);
+        }
+        if (!cpus.empty()) nodes.push_back(std::move(cpus));
+    }
+#endif
+    if (nodes.empty()) nodes.push_back(usable);
+    return nodes;
+}
+
+// Number of CPUs available to this process, taking the affinity mask and
+// the cgroup CPU quota (e.g., docker --cpus) into account.
+// Computed once; falls back to std::thread::hardware_concurrency() on error.
 inline int hardware_concurrency() noexcept {
-    const auto n = std::thread::hardware_concurrency();
-    return n ? static_cast<int>(n) : 1;
+    static const int cached = []() noexcept {
+        try {
+            auto n = static_cast<int>(usable_cpus().size());
+            const double quota = detail::cgroup_cpu_quota();
+            if (quota > 0.0) n = std::min(n, static_cast<int>(std::ceil(quota)));
+            return std::max(n, 1);
+        } catch (...) {
+            const auto n = std::thread::hardware_concurrency();
+            return n ? static_cast<int>(n) : 1;
+        }
+    }();
+    return cached;
+}
+
+// Restrict the calling thread to cpus; false if unsupported or failed
+inline bool pin_this_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (const int cpu: cpus) {
+        if (0 <= cpu && cpu < CPU_SETSIZE) CPU_SET(static_cast<size_t>(cpu), &mask);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    static_cast<void>(cpus);
+    return false;
+#endif
 }
 
+// none: let the OS schedule workers;
+// core: worker i is pinned to the i-th usable CPU (modulo);
+// numa: worker i is pinned to the CPUs of the i-th NUMA node (modulo)
+enum class Affinity {none, core, numa};
+
 // compatible with std::lock_guard<BasicLockable>
 class Semaphore {
   public:
@@ -64,6 +214,141 @@ bool is_ready(const std::future<T>& future) {
 
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 
+template <class Signature>
+class UniqueFunction;
+
+// Move-only std::function without copy requirements on the target.
+// Targets up to buffer_size bytes with nothrow move are stored inline;
+// larger ones are heap-allocated. Dispatch is through a static table of
+// function pointers instead of virtual functions.
+template <class R, class... Args>
+class UniqueFunction<R(Args...)> {
+  public:
+    static constexpr size_t buffer_size = 6u * sizeof(void*);
+
+    UniqueFunction() noexcept = default;
+    UniqueFunction(std::nullptr_t) noexcept {}
+
+    template <class Func, class = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, UniqueFunction>>>
+    UniqueFunction(Func&& func) {
+        using D = std::decay_t<Func>;
+        if constexpr (is_small<D>) {
+            ::new (static_cast<void*>(buffer_)) D(std::forward<Func>(func));
+            vtable_ = &small_vtable<D>;
+        } else {
+            ::new (static_cast<void*>(buffer_)) D*(new D(std::forward<Func>(func)));
+            vtable_ = &heap_vtable<D>;
+        }
+    }
+
+    UniqueFunction(UniqueFunction&& other) noexcept {
+        take(std::move(other));
+    }
+    UniqueFunction& operator=(UniqueFunction&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(std::move(other));
+        }
+        return *this;
+    }
+    UniqueFunction(const UniqueFunction&) = delete;
+    UniqueFunction& operator=(const UniqueFunction&) = delete;
+    ~UniqueFunction() {reset();}
+
+    R operator()(Args... args) {
+        return vtable_->invoke(buffer_, std::forward<Args>(args)...);
+    }
+    explicit operator bool() const noexcept {return vtable_ != nullptr;}
+
+  private:
+    struct VTable {
+        R (*invoke)(void*, Args&&...);
+        void (*move)(void* from, void* to) noexcept;
+        void (*destroy)(void*) noexcept;
+    };
+
+    template <class D>
+    static constexpr bool is_small = sizeof(D) <= buffer_size
+      && alignof(D) <= alignof(std::max_align_t)
+      && std::is_nothrow_move_constructible_v<D>;
+
+    template <class D>
+    static D* target(void* p) noexcept {return std::launder(static_cast<D*>(p));}
+
+    template <class D>
+    static constexpr VTable small_vtable{
+      [](void* p, Args&&... args) -> R {return (*target<D>(p))(std::forward<Args>(args)...);},
+      [](void* from, void* to) noexcept {
+          ::new (to) D(std::move(*target<D>(from)));
+          target<D>(from)->~D();
+      },
+      [](void* p) noexcept {target<D>(p)->~D();}
+    };
+
+    template <class D>
+    static constexpr VTable heap_vtable{
+      [](void* p, Args&&... args) -> R {return (**target<D*>(p))(std::forward<Args>(args)...);},
+      [](void* from, void* to) noexcept {::new (to) D*(*target<D*>(from));},
+      [](void* p) noexcept {delete *target<D*>(p);}
+    };
+
+    void take(UniqueFunction&& other) noexcept {
+        if (!other.vtable_) return;
+        other.vtable_->move(other.buffer_, buffer_);
+        vtable_ = other.vtable_;
+        other.vtable_ = nullptr;
+    }
+    void reset() noexcept {
+        if (!vtable_) return;
+        vtable_->destroy(buffer_);
+        vtable_ = nullptr;
+    }
+
+    alignas(std::max_align_t) unsigned char buffer_[buffer_size];
+    const VTable* vtable_ = nullptr;
+};
+
+namespace detail {
+
+// FIFO on a power-of-two ring whose slots are reused by later elements;
+// memory is allocated only when the queue outgrows its capacity.
+template <class T>
+class RingQueue {
+  public:
+    bool empty() const noexcept {return size_ == 0u;}
+    size_t size() const noexcept {return size_;}
+
+    void push(T&& x) {
+        if (size_ == slots_.size()) grow();
+        slots_[(head_ + size_) & (slots_.size() - 1u)] = std::move(x);
+        ++size_;
+    }
+    T pop() {
+        T x = std::move(slots_[head_]);
+        head_ = (head_ + 1u) & (slots_.size() - 1u);
+        --size_;
+        return x;
+    }
+
+  private:
+    void grow() {
+        std::vector<T> larger(std::max<size_t>(2u * slots_.size(), 64u));
+        for (size_t i=0; i<size_; ++i) {
+            larger[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1u)]);
+        }
+        slots_.swap(larger);
+        head_ = 0u;
+    }
+
+    std::vector<T> slots_;
+    size_t head_ = 0u;
+    size_t size_ = 0u;
+};
+
+} // namespace detail
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
 class BasicTask {
   public:
     BasicTask() noexcept = default;
@@ -87,12 +372,63 @@ class Task: public BasicTask {
     std::packaged_task<result_t()> std_task_;
 };
 
+namespace detail {
+
+template <class Func, class... Args> inline
+auto bind_detached(Func&& func, Args&&... args) {
+    if constexpr (sizeof...(Args) == 0u) {
+        return std::forward<Func>(func);
+    } else {
+        return [func = std::forward<Func>(func), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+            std::apply(func, std::move(args));
+        };
+    }
+}
+
+// Result type of submit_bulk(range, func)
+template <class Range, class Func>
+using bulk_result_t = std::invoke_result_t<Func&, const std::decay_t<decltype(*std::begin(std::declval<const Range&>()))>&>;
+
+// Tasks calling func(x) for x in range; func is shared by all tasks
+template <class Task, class Range, class Func> inline
+auto make_bulk_tasks(const Range& range, Func&& func, std::vector<Task>* tasks) {
+    using result_t = bulk_result_t<Range, Func>;
+    auto shared = std::make_shared<std::decay_t<Func>>(std::forward<Func>(func));
+    std::vector<std::future<result_t>> futures;
+    for (const auto& x: range) {
+        Task task([shared, x]{return (*shared)(x);});
+        futures.push_back(task.get_future());
+        tasks->push_back(std::move(task));
+    }
+    return futures;
+}
+
+} // namespace detail
+
+// BasicTask without a shared state, for submit_detached()
+class DetachedTask: public BasicTask {
+  public:
+    explicit DetachedTask(UniqueFunction<void()>&& func) noexcept: func_(std::move(func)) {}
+    void operator()() override {func_();}
+  private:
+    UniqueFunction<void()> func_;
+};
+
 class ThreadPool {
   public:
-    ThreadPool(int n) {
-        for (int i=0; i<n; ++i) {
-            threads_.emplace_back(&ThreadPool::run, this);
+    ThreadPool(int n, Affinity affinity=Affinity::none) {
+        std::vector<std::vector<int>> sets;
+        if (affinity == Affinity::core) {
+            for (const int cpu: usable_cpus()) {sets.push_back({cpu});}
+        } else if (affinity == Affinity::numa) {
+            sets = numa_nodes();
         }
+        start(n, sets);
+    }
+
+    // all workers pinned to the set of cpus
+    ThreadPool(int n, const std::vector<int>& cpus) {
+        start(n, {cpus});
     }
 
     ~ThreadPool() {
@@ -106,23 +442,52 @@ class ThreadPool {
     template <class Func>
     void submit(Func&& func) {
         std::lock_guard<std::mutex> lck(mutex_);
-        tasks_.push(std::make_unique<Task<void>>(std::forward<Func>(func)));
+        tasks_.push(std::packaged_task<void()>(std::forward<Func>(func)));
         condition_run_.notify_one();
     }
 
+    // func and args are decay-copied into the task
     template <class Func, class... Args>
     auto submit(Func&& func, Args&&... args) {
-        using result_t = std::invoke_result_t<Func, Args...>;
-        std::lock_guard<std::mutex> lck(mutex_);
-        auto task = std::make_unique<Task<result_t>>(
-            [&func, args...]{return func(args...);}
+        using result_t = std::invoke_result_t<std::decay_t<Func>&, std::decay_t<Args>&...>;
+        std::packaged_task<result_t()> task(
+            [func = std::forward<Func>(func), args...]() mutable {return func(args...);}
         );
-        std::future<result_t> ftr = task->get_future();
+        std::future<result_t> ftr = task.get_future();
+        std::lock_guard<std::mutex> lck(mutex_);
         tasks_.push(std::move(task));
         condition_run_.notify_one();
         return ftr;
     }
 
+    // Fire-and-forget: func and args are stored by value without a shared
+    // state; small tasks need no allocation. Use wait() to synchronize.
+    // An exception escaping func calls std::terminate().
+    template <class Func, class... Args>
+    void submit_detached(Func&& func, Args&&... args) {
+        UniqueFunction<void()> task(detail::bind_detached(std::forward<Func>(func), std::forward<Args>(args)...));
+        std::lock_guard<std::mutex> lck(mutex_);
+        tasks_.push(std::move(task));
+        condition_run_.notify_one();
+    }
+
+    // func(x) for each x in range, enqueued under one lock acquisition
+    // and announced with a single notify_all(); futures in range order
+    template <class Range, class Func>
+    auto submit_bulk(const Range& range, Func&& func) {
+        using result_t = detail::bulk_result_t<Range, Func>;
+        std::vector<std::packaged_task<result_t()>> tasks;
+        auto futures = detail::make_bulk_tasks(range, std::forward<Func>(func), &tasks);
+        {
+            std::lock_guard<std::mutex> lck(mutex_);
+            for (auto& task: tasks) {tasks_.push(std::move(task));}
+        }
+        condition_run_.notify_all();
+        return futures;
+    }
+
+    int size() const noexcept {return static_cast<int>(threads_.size());}
+
     // wait for worker threads to finish all tasks without executing join()
     void wait() {
         std::unique_lock<std::mutex> lck(mutex_);
@@ -133,8 +498,18 @@ class ThreadPool {
     }
 
   private:
-    void run() {
-        std::unique_ptr<BasicTask> task = nullptr;
+    // worker i is pinned to sets[i % sets.size()] before taking any task
+    void start(int n, const std::vector<std::vector<int>>& sets) {
+        for (int i=0; i<n; ++i) {
+            std::vector<int> cpus;
+            if (!sets.empty()) cpus = sets[static_cast<size_t>(i) % sets.size()];
+            threads_.emplace_back(&ThreadPool::run, this, std::move(cpus));
+        }
+    }
+
+    void run(std::vector<int> cpus) {
+        if (!cpus.empty()) pin_this_thread(cpus);
+        UniqueFunction<void()> task;
         while (true) {
             {
                 std::unique_lock<std::mutex> lck(mutex_);
@@ -145,15 +520,15 @@ class ThreadPool {
                 });
                 --waiting_threads_;
                 if (tasks_.empty()) return;
-                task = std::move(tasks_.front());
-                tasks_.pop();
+                task = tasks_.pop();
             }
-            (*task)();
+            task();
+            task = nullptr;
         }
     }
 
     std::vector<std::thread> threads_;
-    std::queue<std::unique_ptr<BasicTask>> tasks_;
+    detail::RingQueue<UniqueFunction<void()>> tasks_;
     std::mutex mutex_;
     std::condition_variable condition_run_;
     std::condition_variable condition_wait_;
@@ -161,6 +536,903 @@ class ThreadPool {
     int waiting_threads_ = 0;
 };
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
+namespace detail {
+
+// Chase-Lev work-stealing deque (Le et al. 2013, C11 memory model).
+// push() and pop() are called by the owner only; steal() by anyone.
+// Arrays replaced by grow() are kept until destruction because a thief
+// may still be reading them.
+template <class T>
+class ChaseLevDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "");
+    struct Array {
+        explicit Array(int64_t n):
+          capacity(n), buffer(std::make_unique<std::atomic<T>[]>(static_cast<size_t>(n))) {}
+        T get(int64_t i) const noexcept {
+            return buffer[static_cast<size_t>(i & (capacity - 1))].load(std::memory_order_relaxed);
+        }
+        void put(int64_t i, T x) noexcept {
+            buffer[static_cast<size_t>(i & (capacity - 1))].store(x, std::memory_order_relaxed);
+        }
+        int64_t capacity;
+        std::unique_ptr<std::atomic<T>[]> buffer;
+    };
+
+  public:
+    explicit ChaseLevDeque(int64_t capacity=256) {
+        arrays_.push_back(std::make_unique<Array>(capacity));
+        array_.store(arrays_.back().get(), std::memory_order_relaxed);
+    }
+
+    void push(T x) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) a = grow(a, b, t);
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // newest item (LIFO)
+    bool pop(T* out) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        *out = a->get(b);
+        if (t == b) {
+            const bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // oldest item (FIFO)
+    bool steal(T* out) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        const T x = array_.load(std::memory_order_acquire)->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        *out = x;
+        return true;
+    }
+
+  private:
+    Array* grow(Array* a, int64_t b, int64_t t) {
+        arrays_.push_back(std::make_unique<Array>(2 * a->capacity));
+        Array* bigger = arrays_.back().get();
+        for (int64_t i=t; i<b; ++i) {bigger->put(i, a->get(i));}
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+// pool and index of the worker running on this thread
+struct WorkerIdentity {
+    const void* pool = nullptr;
+    size_t index = 0u;
+};
+
+inline WorkerIdentity& this_worker() noexcept {
+    static thread_local WorkerIdentity identity;
+    return identity;
+}
+
+} // namespace detail
+
+// Drop-in alternative to ThreadPool for many fine-grained tasks.
+// Each worker owns a Chase-Lev deque: tasks submitted from inside a task
+// are pushed there and popped LIFO, idle workers steal from random
+// victims, and submissions from other threads go through a shared queue.
+// Workers with nothing to do sleep until new work arrives.
+class WorkStealingPool {
+  public:
+    WorkStealingPool(int n): deques_(static_cast<size_t>(std::max(n, 0))) {
+        for (auto& d: deques_) {d = std::make_unique<detail::ChaseLevDeque<BasicTask*>>();}
+        for (int i=0; i<n; ++i) {
+            threads_.emplace_back(&WorkStealingPool::run, this, static_cast<size_t>(i));
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lck(park_mutex_);
+            is_being_destroyed_.store(true);
+        }
+        condition_run_.notify_all();
+        for (auto& th: threads_) {
+            th.join();
+        }
+    }
+
+    template <class Func>
+    void submit(Func&& func) {
+        enqueue(std::make_unique<Task<void>>(std::forward<Func>(func)));
+    }
+
+    // func and args are decay-copied into the task
+    template <class Func, class... Args>
+    auto submit(Func&& func, Args&&... args) {
+        using result_t = std::invoke_result_t<std::decay_t<Func>&, std::decay_t<Args>&...>;
+        auto task = std::make_unique<Task<result_t>>(
+            [func = std::forward<Func>(func), args...]() mutable {return func(args...);}
+        );
+        std::future<result_t> ftr = task->get_future();
+        enqueue(std::move(task));
+        return ftr;
+    }
+
+    // Fire-and-forget as ThreadPool::submit_detached()
+    template <class Func, class... Args>
+    void submit_detached(Func&& func, Args&&... args) {
+        enqueue(std::make_unique<DetachedTask>(
+            detail::bind_detached(std::forward<Func>(func), std::forward<Args>(args)...)));
+    }
+
+    // As ThreadPool::submit_bulk()
+    template <class Range, class Func>
+    auto submit_bulk(const Range& range, Func&& func) {
+        using result_t = detail::bulk_result_t<Range, Func>;
+        std::vector<Task<result_t>> tasks;
+        auto futures = detail::make_bulk_tasks(range, std::forward<Func>(func), &tasks);
+        std::vector<std::unique_ptr<BasicTask>> pointers;
+        pointers.reserve(tasks.size());
+        for (auto& task: tasks) {pointers.push_back(std::make_unique<Task<result_t>>(std::move(task)));}
+        enqueue_bulk(std::move(pointers));
+        return futures;
+    }
+
+    int size() const noexcept {return static_cast<int>(threads_.size());}
+
+    // wait for worker threads to finish all tasks without executing join()
+    void wait() {
+        std::unique_lock<std::mutex> lck(wait_mutex_);
+        condition_wait_.wait(lck, [this]{return unfinished_.load() == 0;});
+    }
+
+  private:
+    void enqueue(std::unique_ptr<BasicTask> task) {
+        unfinished_.fetch_add(1);
+        const auto& worker = detail::this_worker();
+        if (worker.pool == this) {
+            deques_[worker.index]->push(task.release());
+        } else {
+            std::lock_guard<std::mutex> lck(inject_mutex_);
+            injected_.push(task.release());
+        }
+        queued_.fetch_add(1);
+        if (sleeping_.load() > 0) {
+            std::lock_guard<std::mutex> lck(park_mutex_);
+            condition_run_.notify_one();
+        }
+    }
+
+    void enqueue_bulk(std::vector<std::unique_ptr<BasicTask>>&& tasks) {
+        if (tasks.empty()) return;
+        const auto n = static_cast<int64_t>(tasks.size());
+        unfinished_.fetch_add(n);
+        const auto& worker = detail::this_worker();
+        if (worker.pool == this) {
+            for (auto& task: tasks) {deques_[worker.index]->push(task.release());}
+        } else {
+            std::lock_guard<std::mutex> lck(inject_mutex_);
+            for (auto& task: tasks) {injected_.push(task.release());}
+        }
+        queued_.fetch_add(n);
+        if (sleeping_.load() > 0) {
+            std::lock_guard<std::mutex> lck(park_mutex_);
+            condition_run_.notify_all();
+        }
+    }
+
+    bool find_task(size_t index, std::minstd_rand& engine, BasicTask** task) {
+        if (deques_[index]->pop(task)) return true;
+        {
+            std::lock_guard<std::mutex> lck(inject_mutex_);
+            if (!injected_.empty()) {
+                *task = injected_.front();
+                injected_.pop();
+                return true;
+            }
+        }
+        const size_t n = deques_.size();
+        const size_t start = static_cast<size_t>(engine()) % n;
+        for (size_t i=0; i<n; ++i) {
+            const size_t victim = (start + i) % n;
+            if (victim != index && deques_[victim]->steal(task)) return true;
+        }
+        return false;
+    }
+
+    void run(size_t index) {
+        detail::this_worker() = detail::WorkerIdentity{this, index};
+        std::minstd_rand engine(static_cast<std::minstd_rand::result_type>(index + 1u));
+        BasicTask* task = nullptr;
+        while (true) {
+            if (find_task(index, engine, &task)) {
+                queued_.fetch_sub(1);
+                (*task)();
+                delete task;
+                if (unfinished_.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lck(wait_mutex_);
+                    condition_wait_.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lck(park_mutex_);
+            sleeping_.fetch_add(1);
+            condition_run_.wait(lck, [this] {
+                return queued_.load() > 0 || is_being_destroyed_.load();
+            });
+            sleeping_.fetch_sub(1);
+            if (queued_.load() <= 0 && is_being_destroyed_.load()) return;
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<detail::ChaseLevDeque<BasicTask*>>> deques_;
+    std::queue<BasicTask*> injected_;
+    std::mutex inject_mutex_;
+    std::mutex park_mutex_;
+    std::mutex wait_mutex_;
+    std::condition_variable condition_run_;
+    std::condition_variable condition_wait_;
+    std::atomic<int64_t> queued_{0};
+    std::atomic<int64_t> unfinished_{0};
+    std::atomic<int> sleeping_{0};
+    std::atomic<bool> is_being_destroyed_{false};
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+
+// One ThreadPool, i.e., one task queue, per NUMA node with its workers
+// pinned to that node. submit() distributes tasks round-robin over nodes;
+// submit_to() keeps a task, and the memory it touches first, on one node.
+// Nodes do not steal from each other.
+class NumaThreadPool {
+  public:
+    // threads_per_node <= 0: one worker per usable CPU of each node
+    explicit NumaThreadPool(int threads_per_node=0) {
+        for (const auto& cpus: numa_nodes()) {
+            const int n = (threads_per_node > 0) ? threads_per_node : static_cast<int>(cpus.size());
+            pools_.push_back(std::make_unique<ThreadPool>(n, cpus));
+        }
+    }
+
+    template <class Func, class... Args>
+    auto submit(Func&& func, Args&&... args) {
+        return submit_to(next_node(), std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    template <class Func, class... Args>
+    auto submit_to(size_t node, Func&& func, Args&&... args) {
+        return pools_.at(node)->submit(std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    template <class Func, class... Args>
+    void submit_detached(Func&& func, Args&&... args) {
+        pools_[next_node()]->submit_detached(std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    int size() const noexcept {
+        int n = 0;
+        for (const auto& pool: pools_) {n += pool->size();}
+        return n;
+    }
+    size_t num_nodes() const noexcept {return pools_.size();}
+    ThreadPool& node(size_t i) {return *pools_.at(i);}
+
+    void wait() {
+        for (auto& pool: pools_) {pool->wait();}
+    }
+
+  private:
+    size_t next_node() noexcept {
+        return next_.fetch_add(1u, std::memory_order_relaxed) % pools_.size();
+    }
+
+    std::vector<std::unique_ptr<ThreadPool>> pools_;
+    std::atomic<size_t> next_{0u};
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// lock-free queues
+//
+// T must be default-constructible and move-assignable. Blocking push/pop
+// spin briefly and then yield; they never sleep on a condition variable.
+
+namespace detail {
+
+constexpr size_t cache_line = 64u;
+
+inline size_t ceil_pow2(size_t n) noexcept {
+    size_t x = 1u;
+    while (x < n) x <<= 1u;
+    return x;
+}
+
+class Backoff {
+  public:
+    void pause() noexcept {
+        if (count_ < spin_limit) {
+            for (int i=0; i<(1 << count_); ++i) {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            ++count_;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+  private:
+    static constexpr int spin_limit = 6;
+    int count_ = 0;
+};
+
+} // namespace detail
+
+// Bounded multi-producer multi-consumer queue (Dmitry Vyukov's design):
+// each cell carries a sequence number, so producers and consumers claim
+// cells with one compare-and-swap on separate cache lines.
+template <class T>
+class MpmcQueue {
+  public:
+    // capacity is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity):
+      mask_(detail::ceil_pow2(std::max<size_t>(capacity, 2u)) - 1u),
+      cells_(std::make_unique<Cell[]>(mask_ + 1u)) {
+        for (size_t i=0; i<=mask_; ++i) {cells_[i].sequence.store(i, std::memory_order_relaxed);}
+    }
+
+    template <class U>
+    bool try_push(U&& x) {
+        size_t pos = enqueue_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (enqueue_.compare_exchange_weak(pos, pos + 1u, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<U>(x);
+        cell->sequence.store(pos + 1u, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T* out) {
+        size_t pos = dequeue_.load(std::memory_order_relaxed);
+        Cell* cell = nullptr;
+        while (true) {
+            cell = &cells_[pos & mask_];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<ptrdiff_t>(seq - (pos + 1u));
+            if (diff == 0) {
+                if (dequeue_.compare_exchange_weak(pos, pos + 1u, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = dequeue_.load(std::memory_order_relaxed);
+            }
+        }
+        *out = std::move(cell->data);
+        cell->sequence.store(pos + mask_ + 1u, std::memory_order_release);
+        return true;
+    }
+
+    template <class U>
+    void push(U&& x) {
+        detail::Backoff backoff;
+        while (!try_push(std::forward<U>(x))) backoff.pause();
+    }
+
+    T pop() {
+        T x;
+        detail::Backoff backoff;
+        while (!try_pop(&x)) backoff.pause();
+        return x;
+    }
+
+    // push [first, first + n) until full; returns the number pushed
+    template <class InputIt>
+    size_t try_push_n(InputIt first, size_t n) {
+        size_t i = 0u;
+        for (; i<n && try_push(*first); ++i, ++first) {}
+        return i;
+    }
+
+    // pop at most n into out; returns the number popped
+    template <class OutputIt>
+    size_t try_pop_n(OutputIt out, size_t n) {
+        size_t i = 0u;
+        T x;
+        for (; i<n && try_pop(&x); ++i) {*out++ = std::move(x);}
+        return i;
+    }
+
+    size_t capacity() const noexcept {return mask_ + 1u;}
+
+  private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(detail::cache_line) std::atomic<size_t> enqueue_{0u};
+    alignas(detail::cache_line) std::atomic<size_t> dequeue_{0u};
+};
+
+// Single-producer single-consumer ring buffer.
+// Each side keeps its index and a cached copy of the other side's index
+// on its own cache line, so the shared line is read only when the cache
+// says the ring looks full (producer) or empty (consumer).
+template <class T>
+class SpscRing {
+  public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity):
+      mask_(detail::ceil_pow2(std::max<size_t>(capacity, 2u)) - 1u),
+      slots_(mask_ + 1u) {}
+
+    template <class U>
+    bool try_push(U&& x) {
+        const size_t tail = producer_.index.load(std::memory_order_relaxed);
+        if (tail - producer_.cached == slots_.size()) {
+            producer_.cached = consumer_.index.load(std::memory_order_acquire);
+            if (tail - producer_.cached == slots_.size()) return false;
+        }
+        slots_[tail & mask_] = std::forward<U>(x);
+        producer_.index.store(tail + 1u, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T* out) {
+        const size_t head = consumer_.index.load(std::memory_order_relaxed);
+        if (head == consumer_.cached) {
+            consumer_.cached = producer_.index.load(std::memory_order_acquire);
+            if (head == consumer_.cached) return false;
+        }
+        *out = std::move(slots_[head & mask_]);
+        consumer_.index.store(head + 1u, std::memory_order_release);
+        return true;
+    }
+
+    template <class U>
+    void push(U&& x) {
+        detail::Backoff backoff;
+        while (!try_push(std::forward<U>(x))) backoff.pause();
+    }
+
+    T pop() {
+        T x;
+        detail::Backoff backoff;
+        while (!try_pop(&x)) backoff.pause();
+        return x;
+    }
+
+    // push up to n items from first with a single index update
+    template <class InputIt>
+    size_t try_push_n(InputIt first, size_t n) {
+        return push_from(first, n);
+    }
+
+    // pop up to n items into out with a single index update
+    template <class OutputIt>
+    size_t try_pop_n(OutputIt out, size_t n) {
+        return pop_into(out, n);
+    }
+
+    // blocking batch versions: return after all n items are transferred
+    template <class InputIt>
+    void push_n(InputIt first, size_t n) {
+        detail::Backoff backoff;
+        while (n > 0u) {
+            const size_t k = push_from(first, n);
+            if (k == 0u) backoff.pause();
+            n -= k;
+        }
+    }
+
+    template <class OutputIt>
+    OutputIt pop_n(OutputIt out, size_t n) {
+        detail::Backoff backoff;
+        while (n > 0u) {
+            const size_t k = pop_into(out, n);
+            if (k == 0u) backoff.pause();
+            n -= k;
+        }
+        return out;
+    }
+
+    size_t capacity() const noexcept {return slots_.size();}
+
+  private:
+    template <class InputIt>
+    size_t push_from(InputIt& first, size_t n) {
+        const size_t tail = producer_.index.load(std::memory_order_relaxed);
+        if (slots_.size() - (tail - producer_.cached) < n) {
+            producer_.cached = consumer_.index.load(std::memory_order_acquire);
+        }
+        n = std::min(n, slots_.size() - (tail - producer_.cached));
+        for (size_t i=0; i<n; ++i, ++first) {slots_[(tail + i) & mask_] = *first;}
+        producer_.index.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    template <class OutputIt>
+    size_t pop_into(OutputIt& out, size_t n) {
+        const size_t head = consumer_.index.load(std::memory_order_relaxed);
+        if (consumer_.cached - head < n) {
+            consumer_.cached = producer_.index.load(std::memory_order_acquire);
+        }
+        n = std::min(n, consumer_.cached - head);
+        for (size_t i=0; i<n; ++i, ++out) {*out = std::move(slots_[(head + i) & mask_]);}
+        consumer_.index.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    struct alignas(detail::cache_line) Side {
+        std::atomic<size_t> index{0u};
+        size_t cached = 0u;  // last seen index of the other side
+    };
+
+    const size_t mask_;
+    std::vector<T> slots_;
+    Side producer_;
+    Side consumer_;
+};
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// parallel loops
+//
+// The range is processed by pool.size() tasks plus the calling thread, so
+// only that many tasks are allocated however small the grain is. The first
+// exception thrown by fn cancels the remaining chunks and is rethrown in
+// the caller. Do not call from a task running on the same ThreadPool.
+
+// fixed: one contiguous slice per task (OpenMP static);
+// dynamic: chunks of `grain` taken on demand;
+// guided: chunks of remaining/(2 * tasks), but not smaller than `grain`
+enum class Schedule {fixed, dynamic, guided};
+
+namespace detail {
+
+template <class Index>
+class RangeScheduler {
+  public:
+    RangeScheduler(Index first, Index last, Index grain, Schedule schedule, size_t ntasks) noexcept:
+      first_(first), last_(last), grain_(std::max(grain, Index{1})),
+      schedule_(schedule), ntasks_(ntasks), next_(first) {}
+
+    // chunk [*lo, *hi) for the count-th call by task; false if none is left
+    bool next(size_t task, size_t count, Index* lo, Index* hi) noexcept {
+        if (cancelled_.load(std::memory_order_relaxed)) return false;
+        switch (schedule_) {
+          case Schedule::fixed: {
+            if (count > 0u) return false;
+            const auto n = static_cast<uintmax_t>(last_ - first_);
+            *lo = static_cast<Index>(first_ + static_cast<Index>(n * task / ntasks_));
+            *hi = static_cast<Index>(first_ + static_cast<Index>(n * (task + 1u) / ntasks_));
+            return *lo < *hi;
+          }
+          case Schedule::dynamic: {
+            *lo = next_.fetch_add(grain_, std::memory_order_relaxed);
+            if (*lo >= last_) return false;
+            *hi = (last_ - *lo > grain_) ? static_cast<Index>(*lo + grain_) : last_;
+            return true;
+          }
+          case Schedule::guided: break;
+        }
+        Index current = next_.load(std::memory_order_relaxed);
+        Index chunk{};
+        do {
+            if (current >= last_) return false;
+            const auto remaining = static_cast<uintmax_t>(last_ - current);
+            chunk = std::max(grain_, static_cast<Index>(remaining / (2u * ntasks_)));
+            chunk = std::min(chunk, static_cast<Index>(last_ - current));
+        } while (!next_.compare_exchange_weak(current, static_cast<Index>(current + chunk), std::memory_order_relaxed));
+        *lo = current;
+        *hi = static_cast<Index>(current + chunk);
+        return true;
+    }
+
+    void cancel(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (!error_) error_ = error;
+        cancelled_.store(true);
+    }
+    void rethrow() const {
+        if (error_) std::rethrow_exception(error_);
+    }
+
+  private:
+    const Index first_;
+    const Index last_;
+    const Index grain_;
+    const Schedule schedule_;
+    const size_t ntasks_;
+    std::atomic<Index> next_;
+    std::atomic<bool> cancelled_{false};
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+// body(task, lo, hi) for each chunk
+template <class Pool, class Index, class Body> inline
+void parallel_chunks(Pool& pool, Index begin_, Index end_, Index grain, Schedule schedule, Body& body) {
+    static_assert(std::is_integral_v<Index>, "");
+    if (!(begin_ < end_)) return;
+    const size_t ntasks = static_cast<size_t>(std::max(pool.size(), 0)) + 1u;
+    RangeScheduler<Index> scheduler(begin_, end_, grain, schedule, ntasks);
+    auto run = [&scheduler, &body](size_t task) {
+        Index lo = 0, hi = 0;
+        try {
+            for (size_t count=0; scheduler.next(task, count, &lo, &hi); ++count) {body(task, lo, hi);}
+        } catch (...) {
+            scheduler.cancel(std::current_exception());
+        }
+    };
+    std::vector<std::future<void>> futures;
+    futures.reserve(ntasks - 1u);
+    for (size_t task=1u; task<ntasks; ++task) {
+        futures.push_back(pool.submit(run, task));
+    }
+    run(0u);
+    for (auto& f: futures) {f.wait();}
+    scheduler.rethrow();
+}
+
+} // namespace detail
+
+// Pool without workers for the serial versions of pool-based algorithms:
+// parallel loops run entirely on the calling thread, and submit() runs
+// the task at once and returns a ready future.
+class SerialPool {
+  public:
+    int size() const noexcept {return 0;}
+
+    template <class Func, class... Args>
+    auto submit(Func&& func, Args&&... args) {
+        using result_t = std::invoke_result_t<std::decay_t<Func>&, std::decay_t<Args>&...>;
+        std::packaged_task<result_t()> task(
+          [func = std::forward<Func>(func), args...]() mutable {return func(args...);});
+        auto future = task.get_future();
+        task();
+        return future;
+    }
+
+    void wait() const noexcept {}
+};
+
+// fn(i) for i in [begin_, end_)
+template <class Pool, class Index, class Func> inline
+void parallel_for(Pool& pool, Index begin_, Index end_, Index grain, Func fn,
+                  Schedule schedule=Schedule::dynamic) {
+    auto body = [&fn](size_t, Index lo, Index hi) {
+        for (Index i=lo; i<hi; ++i) {fn(i);}
+    };
+    detail::parallel_chunks(pool, begin_, end_, grain, schedule, body);
+}
+
+// reduce(...reduce(reduce(init, map(begin_)), map(begin_ + 1))...);
+// chunk results are combined in index order, so the result depends only
+// on the pool size and schedule, not on timing.
+template <class Pool, class Index, class T, class Map, class Reduce> inline
+T parallel_reduce(Pool& pool, Index begin_, Index end_, Index grain, T init, Map map, Reduce reduce,
+                  Schedule schedule=Schedule::dynamic) {
+    const size_t ntasks = static_cast<size_t>(std::max(pool.size(), 0)) + 1u;
+    std::vector<std::vector<std::pair<Index, T>>> partials(ntasks);
+    auto body = [&partials, &map, &reduce](size_t task, Index lo, Index hi) {
+        T acc = map(lo);
+        for (Index i=lo+1; i<hi; ++i) {acc = reduce(std::move(acc), map(i));}
+        partials[task].emplace_back(lo, std::move(acc));
+    };
+    detail::parallel_chunks(pool, begin_, end_, grain, schedule, body);
+    std::vector<std::pair<Index, T>> chunks;
+    for (auto& p: partials) {
+        std::move(p.begin(), p.end(), std::back_inserter(chunks));
+    }
+    std::sort(chunks.begin(), chunks.end(),
+        [](const auto& a, const auto& b) {return a.first < b.first;});
+    for (auto& chunk: chunks) {init = reduce(std::move(init), std::move(chunk.second));}
+    return init;
+}
+
+namespace detail {
+
+// parallel_reduce over chunk(lo, hi) for a partition of [0, n), for loops
+// with chunk-local state such as private histograms. About four chunks
+// per task are balanced dynamically; without workers, chunk(0, n).
+template <class Pool, class T, class Chunk, class Reduce> inline
+T reduce_chunks(Pool& pool, size_t n, T init, Chunk& chunk, Reduce reduce) {
+    const size_t ntasks = static_cast<size_t>(std::max(pool.size(), 0)) + 1u;
+    const size_t nchunks = std::min(n, (ntasks > 1u) ? 4u * ntasks : size_t{1u});
+    return parallel_reduce(pool, size_t{0u}, nchunks, size_t{1u}, std::move(init),
+        [n, nchunks, &chunk](size_t c) {return chunk(n * c / nchunks, n * (c + 1u) / nchunks);},
+        reduce);
+}
+
+} // namespace detail
+
+// d_first[i] = fn(first[i]) for random-access iterators; returns the end of output
+template <class Pool, class InputIt, class OutputIt, class Func> inline
+OutputIt parallel_transform(Pool& pool, InputIt first, InputIt last, OutputIt d_first, ptrdiff_t grain, Func fn,
+                            Schedule schedule=Schedule::dynamic) {
+    const ptrdiff_t n = std::distance(first, last);
+    auto body = [&first, &d_first, &fn](size_t, ptrdiff_t lo, ptrdiff_t hi) {
+        for (ptrdiff_t i=lo; i<hi; ++i) {d_first[i] = fn(first[i]);}
+    };
+    detail::parallel_chunks(pool, ptrdiff_t{0}, n, grain, schedule, body);
+    return d_first + n;
+}
+
+// sink(fn(*it)) in input order while at most max_in_flight tasks are
+// pending (default 4 per worker), so memory stays bounded for long inputs.
+// An exception from fn or sink is rethrown after pending tasks finish.
+template <class Pool, class InputIt, class Func, class Sink> inline
+void parallel_map(Pool& pool, InputIt first, InputIt last, Func fn, Sink sink, size_t max_in_flight=0u) {
+    using result_t = std::invoke_result_t<Func&, const typename std::iterator_traits<InputIt>::value_type&>;
+    if (max_in_flight == 0u) max_in_flight = 4u * static_cast<size_t>(std::max(pool.size(), 1));
+    std::deque<std::future<result_t>> in_flight;
+    try {
+        while (first != last || !in_flight.empty()) {
+            for (; first != last && in_flight.size() < max_in_flight; ++first) {
+                in_flight.push_back(pool.submit(fn, *first));
+            }
+            auto ftr = std::move(in_flight.front());
+            in_flight.pop_front();
+            if constexpr (std::is_void_v<result_t>) {
+                ftr.get();
+                sink();
+            } else {
+                sink(ftr.get());
+            }
+        }
+    } catch (...) {
+        for (auto& f: in_flight) {f.wait();}
+        throw;
+    }
+}
+
+// std::vector of fn(x) for x in range, in input order
+template <class Pool, class Range, class Func> inline
+auto parallel_map(Pool& pool, const Range& range, Func fn, size_t max_in_flight=0u) {
+    using result_t = std::invoke_result_t<Func&, const std::decay_t<decltype(*std::begin(range))>&>;
+    std::vector<result_t> results;
+    parallel_map(pool, std::begin(range), std::end(range), fn,
+                 [&results](result_t&& x) {results.push_back(std::move(x));}, max_in_flight);
+    return results;
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// task graph
+
+// Directed acyclic graph of void() tasks. A node may depend only on nodes
+// added before it, so every graph is acyclic by construction. run() submits
+// the nodes without predecessors; each finishing node submits successors
+// whose predecessors are all done, so no worker blocks on a future.
+// After the first exception, nodes that have not started are skipped and
+// run() rethrows it. A graph can be run repeatedly.
+class TaskGraph {
+  public:
+    struct Timing {
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point finish;
+        std::chrono::nanoseconds duration() const noexcept {return finish - start;}
+    };
+
+    // returns the node id
+    template <class Func>
+    size_t add(Func&& func, const std::vector<size_t>& predecessors={}) {
+        const size_t id = funcs_.size();
+        for (const auto p: predecessors) {
+            if (p >= id) throw std::invalid_argument("unknown predecessor in TaskGraph::add()");
+        }
+        funcs_.emplace_back(std::forward<Func>(func));
+        successors_.emplace_back();
+        num_predecessors_.push_back(predecessors.size());
+        for (const auto p: predecessors) {successors_[p].push_back(id);}
+        timings_.emplace_back();
+        return id;
+    }
+
+    // continuation of a single node
+    template <class Func>
+    size_t then(size_t node, Func&& func) {
+        return add(std::forward<Func>(func), {node});
+    }
+
+    // Execute all nodes on pool and block until they finish;
+    // do not call from a task running on the same pool.
+    template <class Pool>
+    void run(Pool& pool) {
+        const size_t n = funcs_.size();
+        if (n == 0u) return;
+        pending_ = std::make_unique<std::atomic<size_t>[]>(n);
+        for (size_t i=0; i<n; ++i) {pending_[i].store(num_predecessors_[i], std::memory_order_relaxed);}
+        unfinished_ = n;
+        error_ = nullptr;
+        failed_.store(false);
+        for (size_t i=0; i<n; ++i) {
+            if (num_predecessors_[i] == 0u) release(pool, i);
+        }
+        std::unique_lock<std::mutex> lck(mutex_);
+        condition_.wait(lck, [this]{return unfinished_ == 0u;});
+        if (error_) std::rethrow_exception(error_);
+    }
+
+    size_t size() const noexcept {return funcs_.size();}
+    const std::vector<size_t>& successors(size_t node) const {return successors_.at(node);}
+    // start and finish of node in the last run(); equal if it was skipped
+    const Timing& timing(size_t node) const {return timings_.at(node);}
+
+  private:
+    template <class Pool>
+    void release(Pool& pool, size_t node) {
+        pool.submit_detached([this, &pool](size_t id) {execute(pool, id);}, node);
+    }
+
+    template <class Pool>
+    void execute(Pool& pool, size_t node) {
+        auto& timing = timings_[node];
+        timing.start = std::chrono::steady_clock::now();
+        timing.finish = timing.start;
+        if (!failed_.load(std::memory_order_acquire)) {
+            try {
+                funcs_[node]();
+            } catch (...) {
+                std::lock_guard<std::mutex> lck(mutex_);
+                if (!error_) error_ = std::current_exception();
+                failed_.store(true, std::memory_order_release);
+            }
+            timing.finish = std::chrono::steady_clock::now();
+        }
+        for (const auto next: successors_[node]) {
+            if (pending_[next].fetch_sub(1u, std::memory_order_acq_rel) == 1u) release(pool, next);
+        }
+        // last access to *this; run() cannot return before the unlock
+        std::lock_guard<std::mutex> lck(mutex_);
+        if (--unfinished_ == 0u) condition_.notify_all();
+    }
+
+    std::vector<UniqueFunction<void()>> funcs_;
+    std::vector<std::vector<size_t>> successors_;
+    std::vector<size_t> num_predecessors_;
+    std::vector<Timing> timings_;
+    std::unique_ptr<std::atomic<size_t>[]> pending_;
+    size_t unfinished_ = 0u;  // guarded by mutex_
+    std::atomic<bool> failed_{false};
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+};
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 } // namespace wtl
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
@@ -3,6 +3,15 @@
 #define WTL_MATH_HPP_
 
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <valarray>
+#include <vector>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
 
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 namespace wtl {
@@ -25,9 +34,10 @@ constexpr Int permut(Int n, Int r) {
     return r ? (n * permut(n - 1, --r)) : 1;
 }
 
+// C(n, r) = C(n - 1, r - 1) * n / r keeps intermediates small
 template <class Int>
 constexpr Int choose(Int n, Int r) {
-    return permut(n, r) / factorial(r);
+    return r ? (choose(n - 1, r - 1) * n / r) : 1;
 }
 
 template <class ValArray>
@@ -39,24 +49,126 @@ inline auto multinomial(const ValArray& v) {
     return out;
 }
 
+namespace detail {
+
+template <class Int> inline
+Int checked_mul(Int a, Int b) {
+    if (b != 0 && a > std::numeric_limits<Int>::max() / b) {
+        throw std::overflow_error("integer overflow in wtl::checked_mul()");
+    }
+    return a * b;
+}
+
+} // namespace detail
+
+// n! / (n - r)!; throws std::overflow_error if the result does not fit in Int
 template <class Int>
 inline Int permut_runtime(Int n, Int r) {
-    Int answer = n;
-    while (--r) {
-        answer *= --n;
+    Int answer = 1;
+    for (; r > 0; --r, --n) {
+        answer = detail::checked_mul(answer, n);
     }
     return answer;
 }
 
+// Exact binomial coefficient by the multiplicative scheme
+// C(n - r + i, i) = C(n - r + i - 1, i - 1) * (n - r + i) / i,
+// cancelling the gcd first so that an intermediate overflows only if
+// the result does; throws std::overflow_error in that case.
 template <class Int>
 inline Int choose_runtime(Int n, Int r) {
-    Int numerator = n;
-    Int denominator = r;
-    while (--r) {
-        numerator *= --n;
-        denominator *= r;
+    if (r < 0 || n < r) return 0;
+    if (n - r < r) r = n - r;
+    Int answer = 1;
+    for (Int i = 1; i <= r; ++i) {
+        const Int numerator = n - r + i;
+        const Int g = std::gcd(answer, i);
+        answer = detail::checked_mul(answer / g, numerator / (i / g));
+    }
+    return answer;
+}
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// log-space combinatorics
+
+namespace detail {
+
+// log(n!) is tabulated exactly up to this n, and by Stirling series above
+constexpr size_t log_factorial_table_max = 65536u;
+
+// Grown on demand; one table per thread avoids locking in inner loops.
+inline const std::vector<double>& log_factorial_table(size_t n) {
+    thread_local std::vector<double> table{0.0};
+    if (table.size() <= n) {
+        const size_t old_size = table.size();
+        table.resize(std::min(std::max(n + 1u, 2u * old_size), log_factorial_table_max + 1u));
+        // Kahan summation of log(k)
+        double sum = table[old_size - 1u];
+        double compensation = 0.0;
+        for (size_t k=old_size; k<table.size(); ++k) {
+            const double y = std::log(static_cast<double>(k)) - compensation;
+            const double t = sum + y;
+            compensation = (t - sum) - y;
+            table[k] = sum = t;
+        }
+    }
+    return table;
+}
+
+// n log n - n + log(2 pi n) / 2 + 1/(12n) - 1/(360n^3) + 1/(1260n^5)
+inline double log_factorial_stirling(double n) {
+    constexpr double half_log_2pi = 0.91893853320467274178;
+    const double inv = 1.0 / n;
+    const double inv2 = inv * inv;
+    const double series = inv * (1.0 / 12.0 - inv2 * (1.0 / 360.0 - inv2 * (1.0 / 1260.0)));
+    return n * std::log(n) - n + 0.5 * std::log(n) + half_log_2pi + series;
+}
+
+template <class Int> inline
+void check_log_combinatorics(Int n, Int r, const char* message) {
+    if constexpr (std::is_signed_v<Int>) {
+        if (r < 0) throw std::invalid_argument(message);
+    }
+    if (n < r) throw std::invalid_argument(message);
+}
+
+} // namespace detail
+
+// log(n!); throws std::invalid_argument if n < 0
+template <class Int> inline
+double log_factorial(Int n) {
+    detail::check_log_combinatorics(n, Int{}, "n < 0 in wtl::log_factorial()");
+    const auto un = static_cast<size_t>(n);
+    if (un <= detail::log_factorial_table_max) {
+        return detail::log_factorial_table(un)[un];
+    }
+    return detail::log_factorial_stirling(static_cast<double>(n));
+}
+
+// log(n! / (n - r)!) and log(C(n, r));
+// throw std::invalid_argument unless 0 <= r <= n
+template <class Int> inline
+double log_permut(Int n, Int r) {
+    detail::check_log_combinatorics(n, r, "r not in [0, n] in wtl::log_permut()");
+    return log_factorial(n) - log_factorial(n - r);
+}
+
+template <class Int> inline
+double log_choose(Int n, Int r) {
+    detail::check_log_combinatorics(n, r, "r not in [0, n] in wtl::log_choose()");
+    return log_factorial(n) - log_factorial(r) - log_factorial(n - r);
+}
+
+// log((Σx)! / Πx!)
+template <class V> inline
+double log_multinomial(const V& v) {
+    typename V::value_type n{};
+    double denom = 0.0;
+    for (const auto x: v) {
+        n += x;
+        denom += log_factorial(x);
     }
-    return numerator /= denominator;
+    return log_factorial(n) - denom;
 }
 
 // step function: sign, heaviside
@@ -106,6 +218,424 @@ class Tanh {
     const double a_;
 };
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// Array kernels for double
+//
+// Each element is computed by branch-free polynomial code that
+// the compiler can vectorize, unlike calls to std::exp.
+// Selects are bitwise blends, so no masked instructions are needed, and
+// GCC vectorizes all kernels with AVX2 (-march=x86-64-v3) or AVX-512.
+// The kernels ask GCC for the dynamic vectorizer cost model, because
+// the -O2 default rejects these loops; so -O2 -march=native suffices.
+// Plain x86-64 (SSE2) lacks the 64-bit integer lane operations and runs
+// the same code as scalar loops. See benchmark_simd() in test/math.cpp.
+// Max error observed against libm over wide random inputs
+// (see test/math.cpp):
+//   exp: 1 ulp
+//   expm1, log, log1p, sigmoid: 2 ulp
+//   tanh: 4 ulp
+// exp/expm1 handle subnormal results, overflow to inf, and NaN.
+// log/log1p return -inf at 0 and NaN for negative input.
+
+namespace simd {
+
+// Scalar kernels are always inlined into the array loops, which GCC
+// vectorizes with the dynamic cost model even at -O2.
+#if defined(__GNUC__) && !defined(__clang__)
+#  define WTL_SIMD_INLINE __attribute__((always_inline)) inline
+#  define WTL_SIMD_KERNEL __attribute__((optimize("tree-vectorize", "vect-cost-model=dynamic"))) inline
+#elif defined(__clang__)
+#  define WTL_SIMD_INLINE __attribute__((always_inline)) inline
+#  define WTL_SIMD_KERNEL inline
+#else
+#  define WTL_SIMD_INLINE inline
+#  define WTL_SIMD_KERNEL inline
+#endif
+
+namespace detail {
+
+inline uint64_t as_bits(double x) noexcept {
+    uint64_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+inline double as_double(uint64_t u) noexcept {
+    double x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+// c ? a : b as a bitwise blend. Ternaries on double are often turned into
+// branches, and branches that guard floating-point operations keep loops
+// from vectorizing without masked instructions such as AVX-512.
+inline double select(bool c, double a, double b) noexcept {
+    const uint64_t mask = uint64_t{0u} - static_cast<uint64_t>(c);
+    return as_double((as_bits(a) & mask) | (as_bits(b) & ~mask));
+}
+
+// 2^n for n in [-1022, 1023]
+inline double exp2i(int64_t n) noexcept {
+    return as_double(static_cast<uint64_t>(n + 1023) << 52u);
+}
+
+constexpr double ln2_hi = 6.93147180369123816490e-01;
+constexpr double ln2_lo = 1.90821492927058770002e-10;
+constexpr double log2e = 1.44269504088896338700e+00;
+constexpr double round_shifter = 6755399441055744.0;  // 1.5 * 2^52
+
+// x = n ln2 + r with |r| <= ln2 / 2; returns r and sets n
+WTL_SIMD_INLINE double reduce_ln2(double x, int64_t* n) noexcept {
+    const double shifted = x * log2e + round_shifter;
+    *n = static_cast<int64_t>(as_bits(shifted) - as_bits(round_shifter));
+    const double kd = shifted - round_shifter;
+    return (x - kd * ln2_hi) - kd * ln2_lo;
+}
+
+// expm1(r) for |r| <= ln2 / 2 by Taylor series to r^13
+WTL_SIMD_INLINE double expm1_reduced(double r) noexcept {
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    return r + (r * r) * p;
+}
+
+WTL_SIMD_INLINE double exp(double x) noexcept {
+    double xc = select(x == x, x, 0.0);
+    xc = select(xc < -746.0, -746.0, xc);
+    xc = select(xc > 710.0, 710.0, xc);
+    int64_t n;
+    const double r = reduce_ln2(xc, &n);
+    const double y = 1.0 + expm1_reduced(r);
+    // split 2^n so that neither factor over/underflows by itself
+    const int64_t n1 = n / 2;
+    const double result = y * exp2i(n1) * exp2i(n - n1);
+    return select(x == x, result, x);
+}
+
+WTL_SIMD_INLINE double expm1(double x) noexcept {
+    double xc = select(x == x, x, 0.0);
+    xc = select(xc < -40.0, -40.0, xc);
+    xc = select(xc > 710.0, 710.0, xc);
+    int64_t n;
+    const double r = reduce_ln2(xc, &n);
+    const double p = expm1_reduced(r);
+    const int64_t n1 = n / 2;
+    const double scale = exp2i(n1) * exp2i(n - n1);
+    // 2^n * (p + 1) - 1 = 2^n * p + (2^n - 1)
+    const double result = select(n == 0, p, scale * p + (scale - 1.0));
+    return select(x == x, result, x);
+}
+
+// log(m) for m in [sqrt(1/2), sqrt(2)) by 2 atanh((m - 1) / (m + 1))
+WTL_SIMD_INLINE double log_reduced(double m) noexcept {
+    const double f = (m - 1.0) / (m + 1.0);
+    const double s = f * f;
+    double p = 1.0 / 23.0;
+    p = p * s + 1.0 / 21.0;
+    p = p * s + 1.0 / 19.0;
+    p = p * s + 1.0 / 17.0;
+    p = p * s + 1.0 / 15.0;
+    p = p * s + 1.0 / 13.0;
+    p = p * s + 1.0 / 11.0;
+    p = p * s + 1.0 / 9.0;
+    p = p * s + 1.0 / 7.0;
+    p = p * s + 1.0 / 5.0;
+    p = p * s + 1.0 / 3.0;
+    const double two_f = f + f;
+    return two_f + two_f * s * p;
+}
+
+WTL_SIMD_INLINE double log(double x) noexcept {
+    constexpr double min_normal = std::numeric_limits<double>::min();
+    constexpr double sqrt2 = 1.41421356237309504880;
+    const bool subnormal = x < min_normal;
+    const double xn = select(subnormal, x * 18014398509481984.0, x);  // 2^54
+    const uint64_t bits = as_bits(xn);
+    // biased exponent to double via 2^52 + e without int-to-float conversion
+    double e = as_double(((bits >> 52u) & 0x7ffu) | 0x4330000000000000u) - 4503599627370496.0;
+    e -= select(subnormal, 1023.0 + 54.0, 1023.0);
+    double m = as_double((bits & 0x000fffffffffffffu) | 0x3ff0000000000000u);
+    const bool large = m > sqrt2;
+    m = select(large, 0.5 * m, m);
+    e += select(large, 1.0, 0.0);
+    const double de = e;
+    const double result = de * ln2_hi + (log_reduced(m) + de * ln2_lo);
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+    double y = select(x == inf, inf, result);
+    y = select(x == 0.0, -inf, y);
+    y = select(x < 0.0, nan, y);
+    return select(x == x, y, x);
+}
+
+WTL_SIMD_INLINE double log1p(double x) noexcept {
+    const double u = 1.0 + x;
+    const double lu = log(u);
+    // u - 1 differs from x by the rounding of 1 + x
+    const double correction = ((u - 1.0) - x) / u;
+    const bool finite = (u - u) == 0.0;
+    double y = select(u > 0.0, lu - correction, lu);
+    y = select(finite, y, lu);
+    return select(u == 1.0, x, y);
+}
+
+WTL_SIMD_INLINE double sigmoid(double x, double gain) noexcept {
+    return 1.0 / (1.0 + exp(-gain * x));
+}
+
+WTL_SIMD_INLINE double tanh(double x) noexcept {
+    const double ax = std::abs(x);
+    const bool small = ax < 20.0;
+    const double t = expm1(select(small, ax + ax, 40.0));
+    const double result = select(small, t / (t + 2.0), 1.0);
+    return select(x == x, std::copysign(result, x), x);
+}
+
+template <class V> inline
+auto data(V& v) -> decltype(v.data()) {return v.data();}
+template <class T> inline
+T* data(std::valarray<T>& v) {return std::begin(v);}
+template <class T> inline
+const T* data(const std::valarray<T>& v) {return std::begin(v);}
+
+template <class V> inline
+size_t size(const V& v) {return static_cast<size_t>(v.size());}
+
+} // namespace detail
+
+// y[i] = f(x[i]) for i in [0, n); x and y may be the same array
+WTL_SIMD_KERNEL void exp(const double* x, double* y, size_t n) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::exp(x[i]);}
+}
+WTL_SIMD_KERNEL void expm1(const double* x, double* y, size_t n) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::expm1(x[i]);}
+}
+WTL_SIMD_KERNEL void log(const double* x, double* y, size_t n) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::log(x[i]);}
+}
+WTL_SIMD_KERNEL void log1p(const double* x, double* y, size_t n) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::log1p(x[i]);}
+}
+WTL_SIMD_KERNEL void sigmoid(const double* x, double* y, size_t n, double gain=1.0) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::sigmoid(x[i], gain);}
+}
+WTL_SIMD_KERNEL void tanh(const double* x, double* y, size_t n, double a=1.0) noexcept {
+    for (size_t i=0; i<n; ++i) {y[i] = detail::tanh(a * x[i]);}
+}
+
+#undef WTL_SIMD_KERNEL
+#undef WTL_SIMD_INLINE
+
+// log(sum(exp(x))) without overflow
+inline double logsumexp(const double* x, size_t n) noexcept {
+    if (n == 0u) {return -std::numeric_limits<double>::infinity();}
+    const double max = *std::max_element(x, x + n);
+    if (!(std::abs(max) < std::numeric_limits<double>::infinity())) {return max;}
+    double sum = 0.0;
+    for (size_t i=0; i<n; ++i) {sum += detail::exp(x[i] - max);}
+    return max + detail::log(sum);
+}
+
+// In-place and copying versions for contiguous containers with data() and
+// size(), such as std::vector, wtl::Span, and Eigen::Array, or std::valarray.
+#define WTL_SIMD_ARRAY_FUNCTION(NAME) \
+template <class V> inline \
+void NAME(V* x) {NAME(detail::data(*x), detail::data(*x), detail::size(*x));} \
+template <class V> inline \
+V NAME(V x) {NAME(&x); return x;}
+
+WTL_SIMD_ARRAY_FUNCTION(exp)
+WTL_SIMD_ARRAY_FUNCTION(expm1)
+WTL_SIMD_ARRAY_FUNCTION(log)
+WTL_SIMD_ARRAY_FUNCTION(log1p)
+#undef WTL_SIMD_ARRAY_FUNCTION
+
+template <class V> inline
+void sigmoid(V* x, double gain=1.0) {
+    sigmoid(detail::data(*x), detail::data(*x), detail::size(*x), gain);
+}
+template <class V> inline
+V sigmoid(V x, double gain=1.0) {sigmoid(&x, gain); return x;}
+
+template <class V> inline
+void tanh(V* x, double a=1.0) {
+    tanh(detail::data(*x), detail::data(*x), detail::size(*x), a);
+}
+template <class V> inline
+V tanh(V x, double a=1.0) {tanh(&x, a); return x;}
+
+template <class V> inline
+double logsumexp(const V& x) {
+    return logsumexp(detail::data(x), detail::size(x));
+}
+
+} // namespace simd
+
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// Tabulated function approximator
+//
+// Samples func once on [lower, upper] and interpolates afterwards:
+//   linear: uniform grid, error O(h^2)
+//   cubic: uniform grid, 4-point Lagrange, error O(h^4)
+//   chebyshev: n Chebyshev nodes, Clenshaw evaluation of degree n-1
+// Inputs outside [lower, upper] are clamped to the boundary; NaN gives NaN.
+// Throws std::invalid_argument unless lower < upper are finite and n >= 4.
+// error_bound() is the max |approximation - func| measured at
+// construction between nodes, where interpolation error peaks.
+// It is an estimate, not a rigorous bound.
+
+class Tabulated {
+  public:
+    enum class Method {linear, cubic, chebyshev};
+
+    template <class Func>
+    Tabulated(Func func, double lower, double upper, size_t n=1024u, Method method=Method::cubic):
+      lower_(lower), upper_(upper), method_(method), values_(n) {
+        if (n < 4u) throw std::invalid_argument("Tabulated requires n >= 4");
+        if (!(std::isfinite(lower) && std::isfinite(upper) && lower < upper)) {
+            throw std::invalid_argument("Tabulated requires finite lower < upper");
+        }
+        if (method_ == Method::chebyshev) {
+            init_chebyshev(func);
+        } else {
+            step_ = (upper_ - lower_) / static_cast<double>(n - 1u);
+            for (size_t i=0; i<n; ++i) {
+                values_[i] = func(lower_ + step_ * static_cast<double>(i));
+            }
+        }
+        error_bound_ = measure_error(func);
+    }
+
+    double operator()(double x) const {
+        switch (method_) {
+          case Method::linear: return linear(x);
+          case Method::cubic: return cubic(x);
+          default: return chebyshev(x);
+        }
+    }
+
+    // Batch evaluation: y[i] = f(x[i])
+    void operator()(const double* x, double* y, size_t n) const {
+        switch (method_) {
+          case Method::linear:
+            for (size_t i=0; i<n; ++i) {y[i] = linear(x[i]);}
+            break;
+          case Method::cubic:
+            for (size_t i=0; i<n; ++i) {y[i] = cubic(x[i]);}
+            break;
+          default:
+            for (size_t i=0; i<n; ++i) {y[i] = chebyshev(x[i]);}
+        }
+    }
+
+    // Compatible with integrate_adaptive_batch()
+    std::valarray<double> operator()(const std::valarray<double>& x) const {
+        std::valarray<double> y(x.size());
+        operator()(std::begin(x), std::begin(y), x.size());
+        return y;
+    }
+
+    double error_bound() const noexcept {return error_bound_;}
+    double lower() const noexcept {return lower_;}
+    double upper() const noexcept {return upper_;}
+    Method method() const noexcept {return method_;}
+
+  private:
+    template <class Func>
+    void init_chebyshev(Func& func) {
+        constexpr double pi = 3.14159265358979323846;
+        const size_t n = values_.size();
+        const auto dn = static_cast<double>(n);
+        std::vector<double> fx(n);
+        for (size_t k=0; k<n; ++k) {
+            const double u = std::cos(pi * (static_cast<double>(k) + 0.5) / dn);
+            fx[k] = func(0.5 * (upper_ + lower_) + 0.5 * (upper_ - lower_) * u);
+        }
+        for (size_t j=0; j<n; ++j) {
+            double c = 0.0;
+            for (size_t k=0; k<n; ++k) {
+                c += fx[k] * std::cos(pi * static_cast<double>(j) * (static_cast<double>(k) + 0.5) / dn);
+            }
+            values_[j] = 2.0 * c / dn;
+        }
+        values_[0] *= 0.5;
+    }
+
+    template <class Func>
+    double measure_error(Func& func) const {
+        const size_t n = 4u * values_.size();
+        const double h = (upper_ - lower_) / static_cast<double>(n);
+        double max_error = 0.0;
+        for (size_t i=0; i<n; ++i) {
+            const double x = lower_ + h * (static_cast<double>(i) + 0.5);
+            max_error = std::max(max_error, std::abs(operator()(x) - func(x)));
+        }
+        return max_error;
+    }
+
+    // position on the uniform grid: index of the left node and offset t
+    double locate(double x, size_t first, size_t last, size_t* i) const {
+        const double pos = (std::min(std::max(x, lower_), upper_) - lower_) / step_;
+        const double fi = std::min(std::max(std::floor(pos), static_cast<double>(first)),
+                                   static_cast<double>(last));
+        *i = static_cast<size_t>(fi);
+        return pos - fi;
+    }
+
+    double linear(double x) const {
+        if (std::isnan(x)) return x;
+        size_t i;
+        const double t = locate(x, 0u, values_.size() - 2u, &i);
+        const double y0 = values_[i];
+        return y0 + t * (values_[i + 1u] - y0);
+    }
+
+    double cubic(double x) const {
+        if (std::isnan(x)) return x;
+        size_t i;
+        const double t = locate(x, 1u, values_.size() - 3u, &i);
+        const double tp = t + 1.0;
+        const double tm = t - 1.0;
+        const double tmm = t - 2.0;
+        const double* y = values_.data() + i - 1u;
+        return (-t * tm * tmm * y[0] + 3.0 * tp * tm * tmm * y[1]
+                - 3.0 * tp * t * tmm * y[2] + tp * t * tm * y[3]) / 6.0;
+    }
+
+    double chebyshev(double x) const {
+        if (std::isnan(x)) return x;
+        const double xc = std::min(std::max(x, lower_), upper_);
+        const double u = (2.0 * xc - lower_ - upper_) / (upper_ - lower_);
+        const double u2 = 2.0 * u;
+        double b1 = 0.0;
+        double b2 = 0.0;
+        for (size_t j=values_.size(); j-- > 1u;) {
+            const double b0 = values_[j] + u2 * b1 - b2;
+            b2 = b1;
+            b1 = b0;
+        }
+        return values_[0] + u * b1 - b2;
+    }
+
+    double lower_;
+    double upper_;
+    Method method_;
+    double step_ = 0.0;
+    // samples on the uniform grid, or Chebyshev coefficients
+    std::vector<double> values_;
+    double error_bound_ = 0.0;
+};
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 } // namespace wtl
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
@@ -2,6 +2,8 @@
 #ifndef WTL_NUMERIC_HPP_
 #define WTL_NUMERIC_HPP_
 
+#include "concurrent.hpp"
+
 #include <cmath>
 
 #include <numeric>
@@ -9,8 +11,15 @@
 #include <vector>
 #include <valarray>
 #include <map>
+#include <array>
+#include <queue>
+#include <deque>
+#include <iterator>
+#include <functional>
 #include <stdexcept>
 #include <algorithm>
+#include <type_traits>
+#include <utility>
 
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 namespace wtl {
@@ -104,6 +113,205 @@ inline ptrdiff_t count(const std::valarray<bool>& x) {
       });
 }
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// contiguous row-major matrix
+
+// Non-owning view of equally spaced elements
+template <class T>
+class StridedSpan {
+  public:
+    using value_type = std::remove_const_t<T>;
+    StridedSpan(T* data, size_t size, size_t stride) noexcept:
+      data_(data), size_(size), stride_(stride) {}
+    T& operator[](size_t i) const noexcept {return data_[i * stride_];}
+    size_t size() const noexcept {return size_;}
+    size_t stride() const noexcept {return stride_;}
+    T* data() const noexcept {return data_;}
+  private:
+    T* data_;
+    size_t size_;
+    size_t stride_;
+};
+
+// Non-owning view of contiguous elements
+template <class T>
+class Span {
+  public:
+    using value_type = std::remove_const_t<T>;
+    Span(T* data, size_t size) noexcept: data_(data), size_(size) {}
+    T& operator[](size_t i) const noexcept {return data_[i];}
+    size_t size() const noexcept {return size_;}
+    T* data() const noexcept {return data_;}
+    T* begin() const noexcept {return data_;}
+    T* end() const noexcept {return data_ + size_;}
+    operator StridedSpan<T>() const noexcept {return {data_, size_, 1u};}
+  private:
+    T* data_;
+    size_t size_;
+};
+
+// One heap block for the whole table instead of one per row.
+// Constructing from rows of unequal size throws std::invalid_argument.
+template <class T>
+class Matrix {
+  public:
+    using value_type = T;
+    Matrix() = default;
+    Matrix(size_t nrow, size_t ncol, const T& value=T{}):
+      nrow_(nrow), ncol_(ncol), data_(nrow * ncol, value) {}
+    explicit Matrix(const std::vector<std::valarray<T>>& rows):
+      Matrix(rows.size(), common_ncol(rows)) {
+        for (size_t i=0; i<nrow_; ++i) {
+            std::copy(std::begin(rows[i]), std::end(rows[i]), row(i).begin());
+        }
+    }
+
+    T& operator()(size_t i, size_t j) noexcept {return data_[i * ncol_ + j];}
+    const T& operator()(size_t i, size_t j) const noexcept {return data_[i * ncol_ + j];}
+    Span<T> row(size_t i) noexcept {return {data_.data() + i * ncol_, ncol_};}
+    Span<const T> row(size_t i) const noexcept {return {data_.data() + i * ncol_, ncol_};}
+    StridedSpan<T> col(size_t j) noexcept {return {data_.data() + j, nrow_, ncol_};}
+    StridedSpan<const T> col(size_t j) const noexcept {return {data_.data() + j, nrow_, ncol_};}
+
+    size_t nrow() const noexcept {return nrow_;}
+    size_t ncol() const noexcept {return ncol_;}
+    size_t size() const noexcept {return data_.size();}
+    T* data() noexcept {return data_.data();}
+    const T* data() const noexcept {return data_.data();}
+
+    std::vector<std::valarray<T>> to_rows() const {
+        std::vector<std::valarray<T>> rows;
+        rows.reserve(nrow_);
+        for (size_t i=0; i<nrow_; ++i) {
+            rows.emplace_back(row(i).data(), ncol_);
+        }
+        return rows;
+    }
+
+  private:
+    static size_t common_ncol(const std::vector<std::valarray<T>>& rows) {
+        const size_t ncol = rows.empty() ? 0u : rows[0u].size();
+        for (const auto& row_: rows) {
+            if (row_.size() != ncol) throw std::invalid_argument("ragged rows in Matrix()");
+        }
+        return ncol;
+    }
+
+    size_t nrow_ = 0u;
+    size_t ncol_ = 0u;
+    std::vector<T> data_;
+};
+
+// Zero-copy selection of rows; the source matrix must outlive the view
+template <class T>
+class MatrixRows {
+  public:
+    using value_type = T;
+    MatrixRows(const Matrix<T>& matrix, std::vector<size_t> indices) noexcept:
+      matrix_(&matrix), indices_(std::move(indices)) {}
+    Span<const T> row(size_t i) const noexcept {return matrix_->row(indices_[i]);}
+    const T& operator()(size_t i, size_t j) const noexcept {
+        return (*matrix_)(indices_[i], j);
+    }
+    size_t nrow() const noexcept {return indices_.size();}
+    size_t ncol() const noexcept {return matrix_->ncol();}
+    const std::vector<size_t>& indices() const noexcept {return indices_;}
+
+    Matrix<T> copy() const {
+        Matrix<T> out(nrow(), ncol());
+        for (size_t i=0; i<nrow(); ++i) {
+            std::copy(row(i).begin(), row(i).end(), out.row(i).begin());
+        }
+        return out;
+    }
+
+  private:
+    const Matrix<T>* matrix_;
+    std::vector<size_t> indices_;
+};
+
+namespace detail {
+
+template <class M> inline std::valarray<typename M::value_type>
+row_sums_contiguous(const M& matrix) {
+    using T = typename M::value_type;
+    const auto nrow = matrix.nrow();
+    const auto ncol = matrix.ncol();
+    std::valarray<T> sums(nrow);
+    for (size_t i=0; i<nrow; ++i) {
+        const T* x = matrix.row(i).data();
+        T s{};
+        for (size_t j=0; j<ncol; ++j) {s += x[j];}
+        sums[i] = s;
+    }
+    return sums;
+}
+
+template <class M> inline std::valarray<typename M::value_type>
+col_sums_contiguous(const M& matrix) {
+    using T = typename M::value_type;
+    const auto nrow = matrix.nrow();
+    const auto ncol = matrix.ncol();
+    std::valarray<T> sums(ncol);
+    if (ncol == 0u) return sums;
+    T* out = &sums[0u];
+    for (size_t i=0; i<nrow; ++i) {
+        const T* x = matrix.row(i).data();
+        for (size_t j=0; j<ncol; ++j) {out[j] += x[j];}
+    }
+    return sums;
+}
+
+} // namespace detail
+
+template <class T> inline std::valarray<T>
+row_sums(const Matrix<T>& matrix) {return detail::row_sums_contiguous(matrix);}
+template <class T> inline std::valarray<T>
+row_sums(const MatrixRows<T>& matrix) {return detail::row_sums_contiguous(matrix);}
+template <class T> inline std::valarray<T>
+col_sums(const Matrix<T>& matrix) {return detail::col_sums_contiguous(matrix);}
+template <class T> inline std::valarray<T>
+col_sums(const MatrixRows<T>& matrix) {return detail::col_sums_contiguous(matrix);}
+
+// Throw std::invalid_argument if binary.size() != matrix.nrow()
+template <class T> inline MatrixRows<T>
+filter(const Matrix<T>& matrix, const std::valarray<bool>& binary) {
+    std::vector<size_t> indices;
+    const auto nrow = matrix.nrow();
+    if (binary.size() != nrow) throw std::invalid_argument("binary.size() != nrow() in filter()");
+    for (size_t i=0; i<nrow; ++i) {
+        if (binary[i]) indices.push_back(i);
+    }
+    return MatrixRows<T>(matrix, std::move(indices));
+}
+
+// The view would dangle
+template <class T>
+MatrixRows<T> filter(Matrix<T>&&, const std::valarray<bool>&) = delete;
+
+// Tiles keep both source rows and destination rows in cache; block > 0
+template <class T> inline
+Matrix<T> transpose(const Matrix<T>& A, size_t block=32u) {
+    if (block == 0u) throw std::invalid_argument("block == 0 in transpose()");
+    const auto nrow = A.nrow();
+    const auto ncol = A.ncol();
+    Matrix<T> out(ncol, nrow);
+    const T* src = A.data();
+    T* dst = out.data();
+    for (size_t ib=0; ib<nrow; ib+=block) {
+        const auto iend = std::min(ib + block, nrow);
+        for (size_t jb=0; jb<ncol; jb+=block) {
+            const auto jend = std::min(jb + block, ncol);
+            for (size_t i=ib; i<iend; ++i) {
+                for (size_t j=jb; j<jend; ++j) {
+                    dst[j * nrow + i] = src[i * ncol + j];
+                }
+            }
+        }
+    }
+    return out;
+}
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 // for std::vector
 
@@ -158,23 +366,23 @@ typename V::value_type prod(const V& v) {return prod(begin(v), end(v));}
 template <class Iter> inline
 double mean(const Iter begin_, const Iter end_) {
     double x = sum(begin_, end_);
-    return x /= std::distance(begin_, end_);
+    return x /= static_cast<double>(std::distance(begin_, end_));
 }
 template <class V> inline
 double mean(const V& v) {
     double x = sum(v);
-    return x /= v.size();
+    return x /= static_cast<double>(v.size());
 }
 
 
 // geometric (multiplicative) mean
 template <class Iter> inline
 double geomean(const Iter begin_, const Iter end_) {
-    return std::pow(prod(begin_, end_), 1.0 / std::distance(begin_, end_));
+    return std::pow(prod(begin_, end_), 1.0 / static_cast<double>(std::distance(begin_, end_)));
 }
 template <class V> inline
 double geomean(const V& v) {
-    return std::pow(prod(v), 1.0 / v.size());
+    return std::pow(prod(v), 1.0 / static_cast<double>(v.size()));
 }
 
 
@@ -194,6 +402,25 @@ double median(const RandIter begin_, const RandIter end_) {
 template <class V> inline
 double median(V* v) {return median(v->begin(), v->end());}
 
+// quantile by linear interpolation between order statistics (R type 7).
+// Throw std::invalid_argument on empty input or p outside [0, 1].
+template <class RandIter> inline
+double quantile(const RandIter begin_, const RandIter end_, double p) {
+    const auto n = std::distance(begin_, end_);
+    if (n <= 0) throw std::invalid_argument("empty range in quantile()");
+    if (!(0.0 <= p && p <= 1.0)) throw std::invalid_argument("p not in [0, 1] in quantile()");
+    const double h = static_cast<double>(n - 1) * p;
+    const auto lo = static_cast<decltype(n)>(std::floor(h));
+    const RandIter it = begin_ + lo;
+    std::nth_element(begin_, it, end_);
+    const double x_lo = *it;
+    if (lo + 1 >= n) {return x_lo;}
+    const double x_hi = *std::min_element(it + 1, end_);
+    return x_lo + (h - static_cast<double>(lo)) * (x_hi - x_lo);
+}
+template <class V> inline
+double quantile(V* v, double p) {return quantile(v->begin(), v->end(), p);}
+
 
 // deviation squares
 template <class Iter> inline
@@ -217,12 +444,12 @@ typename V::value_type devsq(const V& v, typename V::value_type theta=0) {
 template <class Iter> inline
 double qmean(const Iter begin_, const Iter end_, typename Iter::value_type theta=0) {
     double x = devsq(begin_, end_, theta);
-    return x /= std::distance(begin_, end_);
+    return x /= static_cast<double>(std::distance(begin_, end_));
 }
 template <class V> inline
 double qmean(const V& v, typename V::value_type theta=0) {
     double x = devsq(v, theta);
-    return x /= v.size();
+    return x /= static_cast<double>(v.size());
 }
 
 
@@ -302,9 +529,9 @@ double sem(const Iter begin_, const Iter end_, ptrdiff_t N=0) {
     double fpc(1.0);
     if (N > 0) {
         if (N < n) {throw std::range_error("N<n in sem()");}
-        fpc = (N - n) * (1.0 / (N - 1));
+        fpc = static_cast<double>(N - n) / static_cast<double>(N - 1);
     }
-    return std::sqrt(fpc * var(begin_, end_) / n);
+    return std::sqrt(fpc * var(begin_, end_) / static_cast<double>(n));
 }
 template <class V> inline
 double sem(const V& v, ptrdiff_t N=0) {return sem(begin(v), end(v), N);}
@@ -324,7 +551,7 @@ double cov(const Iter1 begin1, const Iter1 end1, const Iter2 begin2, const Iter2
     );
     auto d = std::distance(begin1, end1);
     if (unbiased) {--d;}
-    return s /= d;
+    return s /= static_cast<double>(d);
 }
 
 template <class V, class U> inline
@@ -332,6 +559,191 @@ double cov(const V& v, const U& u, bool unbiased=true) {
     return cov(v.cbegin(), v.cend(), u.cbegin(), u.cend(), unbiased);
 }
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// sliding window
+
+// Compensated (Kahan) running sum that also accepts subtraction
+class KahanAccumulator {
+  public:
+    void add(double x) noexcept {
+        const double y = x - compensation_;
+        const double t = sum_ + y;
+        compensation_ = (t - sum_) - y;
+        sum_ = t;
+    }
+    void reset(double x=0.0) noexcept {sum_ = x; compensation_ = 0.0;}
+    double value() const noexcept {return sum_;}
+  private:
+    double sum_ = 0.0;
+    double compensation_ = 0.0;
+};
+
+// Mean and variance of the last `window` values in O(1) per push.
+// Values are shifted by the first one to avoid cancellation in Σx²,
+// and sums are recomputed exactly every `refresh` evictions.
+// Throw std::invalid_argument if window == 0.
+class RollingMoments {
+  public:
+    explicit RollingMoments(size_t window, size_t refresh=4096u):
+      buffer_(window), refresh_(refresh) {
+        if (window == 0u) throw std::invalid_argument("window == 0 in RollingMoments");
+    }
+
+    void push(double x) {
+        if (count_ == 0u && evictions_ == 0u) {shift_ = x;}
+        x -= shift_;
+        if (count_ == buffer_.size()) {
+            const double old = buffer_[head_];
+            sum_.add(-old);
+            sumsq_.add(-old * old);
+            ++evictions_;
+        } else {
+            ++count_;
+        }
+        buffer_[head_] = x;
+        sum_.add(x);
+        sumsq_.add(x * x);
+        if (++head_ == buffer_.size()) {head_ = 0u;}
+        if (evictions_ >= refresh_) {recompute();}
+    }
+
+    size_t size() const noexcept {return count_;}
+    bool full() const noexcept {return count_ == buffer_.size();}
+    double sum() const noexcept {
+        return sum_.value() + shift_ * static_cast<double>(count_);
+    }
+    double mean() const noexcept {
+        return sum_.value() / static_cast<double>(count_) + shift_;
+    }
+    double var(bool unbiased=true) const noexcept {
+        const auto n = static_cast<double>(count_);
+        const double s = sum_.value();
+        const double ss = std::max(sumsq_.value() - s * s / n, 0.0);
+        return ss / (unbiased ? n - 1.0 : n);
+    }
+
+  private:
+    void recompute() noexcept {
+        sum_.reset();
+        sumsq_.reset();
+        for (size_t i=0; i<count_; ++i) {
+            sum_.add(buffer_[i]);
+            sumsq_.add(buffer_[i] * buffer_[i]);
+        }
+        evictions_ = 0u;
+    }
+
+    std::vector<double> buffer_;
+    size_t refresh_;
+    size_t head_ = 0u;
+    size_t count_ = 0u;
+    size_t evictions_ = 0u;
+    double shift_ = 0.0;
+    KahanAccumulator sum_;
+    KahanAccumulator sumsq_;
+};
+
+// Minimum (std::less) or maximum (std::greater) of the last `window` values
+// with a monotonic deque: O(1) amortized per push.
+// Throw std::invalid_argument if window == 0.
+template <class T, class Compare=std::less<T>>
+class RollingExtremum {
+  public:
+    explicit RollingExtremum(size_t window, Compare comp=Compare{}):
+      window_(window), comp_(comp) {
+        if (window == 0u) throw std::invalid_argument("window == 0 in RollingExtremum");
+    }
+
+    void push(const T& x) {
+        while (!deque_.empty() && !comp_(deque_.back().second, x)) {
+            deque_.pop_back();
+        }
+        deque_.emplace_back(position_, x);
+        if (deque_.front().first + window_ <= position_) {deque_.pop_front();}
+        ++position_;
+    }
+
+    const T& value() const {return deque_.front().second;}
+
+  private:
+    size_t window_;
+    Compare comp_;
+    size_t position_ = 0u;
+    std::deque<std::pair<size_t, T>> deque_;
+};
+
+template <class T> using RollingMin = RollingExtremum<T, std::less<T>>;
+template <class T> using RollingMax = RollingExtremum<T, std::greater<T>>;
+
+namespace detail {
+
+inline void check_rolling(size_t window, size_t step) {
+    if (window == 0u) throw std::invalid_argument("window == 0 in rolling_*()");
+    if (step == 0u) throw std::invalid_argument("step == 0 in rolling_*()");
+}
+
+} // namespace detail
+
+// Number of windows of width `window` starting every `step` values in n values.
+// Throw std::invalid_argument if window or step is 0.
+inline size_t rolling_size(size_t n, size_t window, size_t step=1u) {
+    detail::check_rolling(window, step);
+    return (n < window) ? 0u : (n - window) / step + 1u;
+}
+
+namespace detail {
+
+// Push every value once; emit after each complete window at the given step
+template <class Iter, class OutIter, class Accumulator, class Emit> inline
+OutIter rolling(Iter first, const Iter last, size_t window, size_t step,
+                OutIter out, Accumulator& acc, Emit emit) {
+    check_rolling(window, step);
+    size_t i = 0;
+    for (; first != last; ++first) {
+        acc.push(*first);
+        if (++i >= window && (i - window) % step == 0u) {
+            *out = emit(acc);
+            ++out;
+        }
+    }
+    return out;
+}
+
+} // namespace detail
+
+// Write statistics of windows [k * step, k * step + window) to `out`,
+// which must have room for rolling_size(n, window, step) values.
+// Throw std::invalid_argument if window or step is 0.
+template <class Iter, class OutIter> inline
+OutIter rolling_mean(Iter first, Iter last, size_t window, OutIter out, size_t step=1u) {
+    RollingMoments acc(window);
+    return detail::rolling(first, last, window, step, out, acc,
+                           [](const RollingMoments& m) {return m.mean();});
+}
+
+template <class Iter, class OutIter> inline
+OutIter rolling_var(Iter first, Iter last, size_t window, OutIter out, size_t step=1u, bool unbiased=true) {
+    RollingMoments acc(window);
+    return detail::rolling(first, last, window, step, out, acc,
+                           [unbiased](const RollingMoments& m) {return m.var(unbiased);});
+}
+
+template <class Iter, class OutIter> inline
+OutIter rolling_min(Iter first, Iter last, size_t window, OutIter out, size_t step=1u) {
+    using T = typename std::iterator_traits<Iter>::value_type;
+    RollingMin<T> acc(window);
+    return detail::rolling(first, last, window, step, out, acc,
+                           [](const RollingMin<T>& m) {return m.value();});
+}
+
+template <class Iter, class OutIter> inline
+OutIter rolling_max(Iter first, Iter last, size_t window, OutIter out, size_t step=1u) {
+    using T = typename std::iterator_traits<Iter>::value_type;
+    RollingMax<T> acc(window);
+    return detail::rolling(first, last, window, step, out, acc,
+                           [](const RollingMax<T>& m) {return m.value();});
+}
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 // rank
 template <class Iter> inline
@@ -429,12 +841,12 @@ typename V::value_type squared_euclidean(const V& v, const U& u) {
 // Simpson Diversity D
 template <class V> inline
 double simpson_diversity(const V& v) {
-    const double square1_N = std::pow(1.0 / sum(v), 2);
+    const double square1_N = std::pow(1.0 / static_cast<double>(sum(v)), 2);
     double d = 0.0;
     for (const auto& x: v) {
         auto tmp = square1_N;
-        tmp *= x;
-        tmp *= x;
+        tmp *= static_cast<double>(x);
+        tmp *= static_cast<double>(x);
         d += tmp;
     }
     return d;
@@ -454,15 +866,84 @@ double shannon_diversity(const V& v) {
             nlogn += dn;
         }
     }
-    return std::log(n) - nlogn / n;
+    return std::log(n) - nlogn / static_cast<double>(n);
 }
 
-template <class Matrix> inline
-Matrix transpose(const Matrix& A) {
+// Shannon's H' and Simpson's D of counts that change a few at a time.
+// Σn and Σn² are kept exactly in T; Σn·log(n) is updated in O(1) per
+// change and recomputed from scratch every `refresh` changes.
+template <class T=ptrdiff_t>
+class DiversityTracker {
+  public:
+    template <class V>
+    explicit DiversityTracker(const V& counts, size_t refresh=65536u):
+      counts_(std::begin(counts), std::end(counts)), refresh_(refresh) {
+        recompute();
+    }
+
+    void set(size_t i, T value) {
+        remove_term(counts_[i]);
+        counts_[i] = value;
+        add_term(value);
+        if (++updates_ >= refresh_) {recompute();}
+    }
+    void add(size_t i, T delta) {set(i, counts_[i] + delta);}
+
+    double shannon() const noexcept {
+        if (counts_.size() < 2u) {return 0.0;}
+        const auto n = static_cast<double>(sum_);
+        return std::log(n) - nlogn_ / n;
+    }
+    double simpson() const noexcept {
+        const auto n = static_cast<double>(sum_);
+        return static_cast<double>(sumsq_) / (n * n);
+    }
+
+    const std::vector<T>& counts() const noexcept {return counts_;}
+    T sum() const noexcept {return sum_;}
+
+    void recompute() {
+        sum_ = T{};
+        sumsq_ = T{};
+        nlogn_ = 0.0;
+        for (const auto n_i: counts_) {add_term(n_i);}
+        updates_ = 0u;
+    }
+
+  private:
+    static double nlogn(T n) {
+        const auto dn = static_cast<double>(n);
+        return dn * std::log(dn);
+    }
+    void add_term(T n_i) {
+        if (n_i > T{}) {
+            sum_ += n_i;
+            sumsq_ += n_i * n_i;
+            nlogn_ += nlogn(n_i);
+        }
+    }
+    void remove_term(T n_i) {
+        if (n_i > T{}) {
+            sum_ -= n_i;
+            sumsq_ -= n_i * n_i;
+            nlogn_ -= nlogn(n_i);
+        }
+    }
+
+    std::vector<T> counts_;
+    size_t refresh_;
+    size_t updates_ = 0u;
+    T sum_{};
+    T sumsq_{};
+    double nlogn_ = 0.0;
+};
+
+template <class RowContainer> inline
+RowContainer transpose(const RowContainer& A) {
     const auto nrow = A.size();
     if (nrow == 0u) return A;
     const auto ncol = A[0u].size();
-    Matrix out(ncol, typename Matrix::value_type(nrow));
+    RowContainer out(ncol, typename RowContainer::value_type(nrow));
     for (auto row = decltype(nrow){}; row < nrow; ++row) {
         for (auto col = decltype(ncol){}; col < ncol; ++col) {
             out[col][row] = A[row][col];
@@ -471,17 +952,179 @@ Matrix transpose(const Matrix& A) {
     return out;
 }
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// histogram
+
+namespace detail {
+
+template <class Iter> inline
+void bincount(Iter first, const Iter last, ptrdiff_t* counts, size_t nbins) {
+    for (; first != last; ++first) {
+        const auto bin = static_cast<size_t>(*first);
+        if (bin < nbins) ++counts[bin];
+    }
+}
+
+inline void check_histogram_range(size_t nbins, double lower, double upper) {
+    if (nbins == 0u) throw std::invalid_argument("nbins == 0 in histogram()");
+    if (!(lower < upper) || !std::isfinite(upper - lower)) {
+        throw std::invalid_argument("!(lower < upper) in histogram()");
+    }
+}
+
+inline void check_histogram_edges(const std::vector<double>& edges) {
+    if (edges.size() < 2u) throw std::invalid_argument("edges.size() < 2 in histogram()");
+    for (size_t i=1; i<edges.size(); ++i) {
+        if (!(edges[i - 1u] < edges[i])) {
+            throw std::invalid_argument("edges not strictly increasing in histogram()");
+        }
+    }
+}
+
+// Bin indices are computed for a block of values at once (branch-free,
+// vectorizable), then scattered; out-of-range values get -1.
+// Range checks and clamping are done in double before the cast,
+// so NaN and +-inf are skipped like other out-of-range values.
+template <class Iter> inline
+void histogram(Iter first, const Iter last, ptrdiff_t* counts, size_t nbins,
+               double lower, double upper) {
+    constexpr size_t block = 256u;
+    std::array<ptrdiff_t, block> bins;
+    std::array<double, block> x;
+    const double scale = static_cast<double>(nbins) / (upper - lower);
+    const auto last_bin = static_cast<double>(nbins - 1u);
+    while (first != last) {
+        size_t n = 0;
+        for (; n < block && first != last; ++n, ++first) {
+            x[n] = static_cast<double>(*first);
+        }
+        for (size_t i=0; i<n; ++i) {
+            double bin = std::min((x[i] - lower) * scale, last_bin);
+            bin = (lower <= x[i]) ? bin : -1.0;
+            bin = (x[i] <= upper) ? bin : -1.0;
+            bins[i] = static_cast<ptrdiff_t>(bin);
+        }
+        for (size_t i=0; i<n; ++i) {
+            if (bins[i] >= 0) ++counts[bins[i]];
+        }
+    }
+}
+
+template <class Iter> inline
+void histogram(Iter first, const Iter last, ptrdiff_t* counts,
+               const std::vector<double>& edges) {
+    const auto lower = edges.front();
+    const auto upper = edges.back();
+    const auto last_bin = static_cast<ptrdiff_t>(edges.size()) - 2;
+    for (; first != last; ++first) {
+        const auto x = static_cast<double>(*first);
+        if (!(lower <= x && x <= upper)) continue;
+        const auto it = std::upper_bound(edges.begin(), edges.end(), x);
+        ++counts[std::min(std::distance(edges.begin(), it) - 1, last_bin)];
+    }
+}
+
+// Each chunk fills a private histogram; they are merged in chunk order.
+template <class Pool, class RandIter, class Fill> inline
+std::vector<ptrdiff_t>
+parallel_histogram(Pool& pool, RandIter first, RandIter last, size_t nbins, Fill fill) {
+    const auto n = static_cast<size_t>(std::distance(first, last));
+    auto chunk = [first, nbins, &fill](size_t begin_, size_t end_) {
+        std::vector<ptrdiff_t> counts(nbins);
+        fill(first + static_cast<ptrdiff_t>(begin_), first + static_cast<ptrdiff_t>(end_), counts.data());
+        return counts;
+    };
+    return reduce_chunks(pool, n, std::vector<ptrdiff_t>(nbins), chunk,
+        [nbins](std::vector<ptrdiff_t> counts, const std::vector<ptrdiff_t>& partial) {
+            for (size_t i=0; i<nbins; ++i) {counts[i] += partial[i];}
+            return counts;
+        });
+}
+
+} // namespace detail
+
+// Count occurrences of integer keys in [0, nbins); others are ignored
+template <class Iter> inline
+std::vector<ptrdiff_t> bincount(Iter first, Iter last, size_t nbins) {
+    std::vector<ptrdiff_t> counts(nbins);
+    detail::bincount(first, last, counts.data(), nbins);
+    return counts;
+}
+template <class V> inline
+std::vector<ptrdiff_t> bincount(const V& v, size_t nbins) {
+    return bincount(std::begin(v), std::end(v), nbins);
+}
+
+// nbins equal-width bins over [lower, upper]; the last bin is closed.
+// Values outside the range and NaN are ignored.
+// Throw std::invalid_argument unless nbins > 0 and lower < upper.
+template <class Iter> inline
+std::vector<ptrdiff_t> histogram(Iter first, Iter last, size_t nbins, double lower, double upper) {
+    detail::check_histogram_range(nbins, lower, upper);
+    std::vector<ptrdiff_t> counts(nbins);
+    detail::histogram(first, last, counts.data(), nbins, lower, upper);
+    return counts;
+}
+template <class V> inline
+std::vector<ptrdiff_t> histogram(const V& v, size_t nbins, double lower, double upper) {
+    return histogram(std::begin(v), std::end(v), nbins, lower, upper);
+}
+
+// Bins [edges[i], edges[i + 1]) found by bisection; the last bin is closed.
+// edges must be strictly increasing; otherwise std::invalid_argument.
+template <class Iter> inline
+std::vector<ptrdiff_t> histogram(Iter first, Iter last, const std::vector<double>& edges) {
+    detail::check_histogram_edges(edges);
+    std::vector<ptrdiff_t> counts(edges.size() - 1u);
+    detail::histogram(first, last, counts.data(), edges);
+    return counts;
+}
+template <class V> inline
+std::vector<ptrdiff_t> histogram(const V& v, const std::vector<double>& edges) {
+    return histogram(std::begin(v), std::end(v), edges);
+}
+
+// Parallel versions with ThreadPool-like pool (size() and submit(func, args...))
+template <class Pool, class RandIter> inline
+std::vector<ptrdiff_t> bincount(Pool& pool, RandIter first, RandIter last, size_t nbins) {
+    return detail::parallel_histogram(pool, first, last, nbins,
+        [nbins](RandIter begin_, RandIter end_, ptrdiff_t* counts) {
+            detail::bincount(begin_, end_, counts, nbins);
+        });
+}
+
+template <class Pool, class RandIter> inline
+std::vector<ptrdiff_t> histogram(Pool& pool, RandIter first, RandIter last, size_t nbins, double lower, double upper) {
+    detail::check_histogram_range(nbins, lower, upper);
+    return detail::parallel_histogram(pool, first, last, nbins,
+        [nbins, lower, upper](RandIter begin_, RandIter end_, ptrdiff_t* counts) {
+            detail::histogram(begin_, end_, counts, nbins, lower, upper);
+        });
+}
+
+template <class Pool, class RandIter> inline
+std::vector<ptrdiff_t> histogram(Pool& pool, RandIter first, RandIter last, const std::vector<double>& edges) {
+    detail::check_histogram_edges(edges);
+    return detail::parallel_histogram(pool, first, last, edges.size() - 1u,
+        [&edges](RandIter begin_, RandIter end_, ptrdiff_t* counts) {
+            detail::histogram(begin_, end_, counts, edges);
+        });
+}
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 // numerical integration
 
+// Abscissae are computed from an integer index;
+// accumulating x+=step can drop or add the last point by rounding.
+
 template <class Func> inline
 double integrate_trapezoid(Func func, double lower, double upper, int precision=100) {
     const double step = (upper - lower) / static_cast<double>(precision);
     double result = func(lower);
     result += func(upper);
     result *= 0.5;
-    for (double x=lower + step; x<upper; x+=step) {
-        result += func(x);
+    for (int i=1; i<precision; ++i) {
+        result += func(lower + step * static_cast<double>(i));
     }
     return result *= step;
 }
@@ -490,8 +1133,8 @@ template <class Func> inline
 double integrate_midpoint(Func func, double lower, double upper, int precision=100) {
     const double step = (upper - lower) / static_cast<double>(precision);
     double result = 0.0;
-    for (double x=lower + 0.5 * step; x<upper; x+=step) {
-        result += func(x);
+    for (int i=0; i<precision; ++i) {
+        result += func(lower + step * (static_cast<double>(i) + 0.5));
     }
     return result *= step;
 }
@@ -499,15 +1142,14 @@ double integrate_midpoint(Func func, double lower, double upper, int precision=1
 template <class Func> inline
 double integrate_simpson(Func func, double lower, double upper, int precision=100) {
     const double step = (upper - lower) / static_cast<double>(precision);
-    const double double_step = step * 2.0;
     double result_odd = 0.0;
-    for (double x=lower + step; x<upper; x+=double_step) {
-        result_odd += func(x);
+    for (int i=1; i<precision; i+=2) {
+        result_odd += func(lower + step * static_cast<double>(i));
     }
     result_odd *= 4.0;
     double result_even = 0.0;
-    for (double x=lower + double_step; x<upper; x+=double_step) {
-        result_even += func(x);
+    for (int i=2; i<precision; i+=2) {
+        result_even += func(lower + step * static_cast<double>(i));
     }
     result_even *= 2.0;
     double result = func(lower);
@@ -523,6 +1165,194 @@ double integrate(Func func, double lower, double upper, int precision=100) {
     return integrate_simpson(func, lower, upper, precision);
 }
 
+/////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
+// adaptive Gauss-Kronrod quadrature
+
+// Nodes and weights from QUADPACK (Piessens et al. 1983).
+// nodes[0..m) are symmetric pairs ±x, nodes[m] is the center;
+// gauss[i] is zero where the node is Kronrod-only.
+struct gauss_kronrod_15 {
+    static constexpr size_t size = 15u;
+    static constexpr std::array<double, 8> nodes = {
+        0.991455371120812639206854697526329,
+        0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926,
+        0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013,
+        0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245,
+        0.000000000000000000000000000000000
+    };
+    static constexpr std::array<double, 8> kronrod = {
+        0.022935322010529224963732008058970,
+        0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518,
+        0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550,
+        0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649,
+        0.209482141084727828012999174891714
+    };
+    static constexpr std::array<double, 8> gauss = {
+        0.0, 0.129484966168869693270611432679082,
+        0.0, 0.279705391489276667901467771423780,
+        0.0, 0.381830050505118944950369775488975,
+        0.0, 0.417959183673469387755102040816327
+    };
+};
+
+struct gauss_kronrod_21 {
+    static constexpr size_t size = 21u;
+    static constexpr std::array<double, 11> nodes = {
+        0.995657163025808080735527280689003,
+        0.973906528517171720077964012084452,
+        0.930157491355708226001207180059508,
+        0.865063366688984510732096688423493,
+        0.780817726586416897063717578345042,
+        0.679409568299024406234327365114874,
+        0.562757134668604683339000099272694,
+        0.433395394129247190799265943165784,
+        0.294392862701460198131126603103866,
+        0.148874338981631210884826001129720,
+        0.000000000000000000000000000000000
+    };
+    static constexpr std::array<double, 11> kronrod = {
+        0.011694638867371874278064396062192,
+        0.032558162307964727478818972459390,
+        0.054755896574351996031381300244580,
+        0.075039674810919952767043140916190,
+        0.093125454583697605535065465083366,
+        0.109387158802297641899210590325805,
+        0.123491976262065851077208980081140,
+        0.134709217311473325928054001771707,
+        0.142775938577060080797094273138717,
+        0.147739104901338491374841515972068,
+        0.149445554002916905664936468389821
+    };
+    static constexpr std::array<double, 11> gauss = {
+        0.0, 0.066671344308688137593568809893332,
+        0.0, 0.149451349150580593145776339657697,
+        0.0, 0.219086362515982043995534934228163,
+        0.0, 0.269266719309996355091226921569469,
+        0.0, 0.295524224714752870173892994651338,
+        0.0
+    };
+};
+
+namespace detail {
+
+struct QuadratureInterval {
+    double lower;
+    double upper;
+    double value;
+    double error;
+    bool operator<(const QuadratureInterval& other) const noexcept {
+        return error < other.error;
+    }
+};
+
+// Abscissae in the order c-hx_0, c+hx_0, c-hx_1, c+hx_1, ..., c
+template <class Rule> inline
+void gauss_kronrod_abscissae(double lower, double upper, double* x) {
+    constexpr size_t m = Rule::size / 2u;
+    const double center = 0.5 * (lower + upper);
+    const double half = 0.5 * (upper - lower);
+    for (size_t i=0; i<m; ++i) {
+        const double dx = half * Rule::nodes[i];
+        x[2u * i] = center - dx;
+        x[2u * i + 1u] = center + dx;
+    }
+    x[2u * m] = center;
+}
+
+template <class Rule> inline
+QuadratureInterval gauss_kronrod_estimate(double lower, double upper, const double* fx) {
+    constexpr size_t m = Rule::size / 2u;
+    double k = Rule::kronrod[m] * fx[2u * m];
+    double g = Rule::gauss[m] * fx[2u * m];
+    for (size_t i=0; i<m; ++i) {
+        const double pair = fx[2u * i] + fx[2u * i + 1u];
+        k += Rule::kronrod[i] * pair;
+        g += Rule::gauss[i] * pair;
+    }
+    const double half = 0.5 * (upper - lower);
+    return {lower, upper, k * half, std::abs((k - g) * half)};
+}
+
+// Bisect the interval with the largest error estimate until
+// the sum of errors falls below max(abs_tol, rel_tol * |result|).
+// `evaluate` fills fx for a batch of n intervals given their abscissae.
+template <class Rule, class Evaluate> inline
+double integrate_adaptive_impl(Evaluate evaluate, double lower, double upper,
+                               double abs_tol, double rel_tol, int max_intervals,
+                               double* error) {
+    constexpr size_t n = Rule::size;
+    std::array<double, 2u * n> x;
+    std::array<double, 2u * n> fx;
+    gauss_kronrod_abscissae<Rule>(lower, upper, x.data());
+    evaluate(x.data(), fx.data(), n);
+    std::priority_queue<QuadratureInterval> heap;
+    heap.push(gauss_kronrod_estimate<Rule>(lower, upper, fx.data()));
+    double result = heap.top().value;
+    double total_error = heap.top().error;
+    for (int i=1; i<max_intervals; ++i) {
+        if (total_error <= std::max(abs_tol, rel_tol * std::abs(result))) break;
+        const QuadratureInterval worst = heap.top();
+        heap.pop();
+        const double mid = 0.5 * (worst.lower + worst.upper);
+        gauss_kronrod_abscissae<Rule>(worst.lower, mid, x.data());
+        gauss_kronrod_abscissae<Rule>(mid, worst.upper, x.data() + n);
+        evaluate(x.data(), fx.data(), 2u * n);
+        const auto left = gauss_kronrod_estimate<Rule>(worst.lower, mid, fx.data());
+        const auto right = gauss_kronrod_estimate<Rule>(mid, worst.upper, fx.data() + n);
+        result += left.value + right.value - worst.value;
+        total_error += left.error + right.error - worst.error;
+        heap.push(left);
+        heap.push(right);
+    }
+    // recompute to discard rounding accumulated by the running updates
+    result = 0.0;
+    total_error = 0.0;
+    for (; !heap.empty(); heap.pop()) {
+        result += heap.top().value;
+        total_error += heap.top().error;
+    }
+    if (error) {*error = total_error;}
+    return result;
+}
+
+} // namespace detail
+
+// Adaptive quadrature with error control: G7K15 or G10K21 (default)
+template <class Rule=gauss_kronrod_21, class Func> inline
+double integrate_adaptive(Func func, double lower, double upper,
+                          double abs_tol=1e-10, double rel_tol=1e-10,
+                          int max_intervals=1000, double* error=nullptr) {
+    return detail::integrate_adaptive_impl<Rule>(
+        [&func](const double* x, double* fx, size_t n) {
+            for (size_t i=0; i<n; ++i) {fx[i] = func(x[i]);}
+        },
+        lower, upper, abs_tol, rel_tol, max_intervals, error);
+}
+
+// Batch mode: func receives all abscissae of one or two intervals at once
+// as std::valarray<double> and returns f(x) elementwise,
+// e.g., [](const std::valarray<double>& x) {return std::exp(-x * x);}
+template <class Rule=gauss_kronrod_21, class Func> inline
+double integrate_adaptive_batch(Func func, double lower, double upper,
+                                double abs_tol=1e-10, double rel_tol=1e-10,
+                                int max_intervals=1000, double* error=nullptr) {
+    std::valarray<double> xs(2u * Rule::size);
+    return detail::integrate_adaptive_impl<Rule>(
+        [&func, &xs](const double* x, double* fx, size_t n) {
+            if (xs.size() != n) {xs.resize(n);}
+            std::copy(x, x + n, std::begin(xs));
+            const std::valarray<double> ys = func(xs);
+            std::copy(std::begin(ys), std::end(ys), fx);
+        },
+        lower, upper, abs_tol, rel_tol, max_intervals, error);
+}
+
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
 } // namespace wtl
 /////////1/////////2/////////3/////////4/////////5/////////6/////////7/////////
@@ -0,0 +1,82 @@
+#include <wtl/bootstrap.hpp>
+#include <wtl/concurrent.hpp>
+#include <wtl/random.hpp>
+#include <wtl/exception.hpp>
+#include <wtl/iostr.hpp>
+
+inline void test_bootstrap(wtl::ThreadPool& pool) {
+    std::normal_distribution<double> normal(10.0, 2.0);
+    std::vector<double> x(200);
+    for (auto& x_i: x) {x_i = normal(wtl::mt64());}
+    const auto mean_dist = wtl::bootstrap(pool, x, [](std::vector<double>& v) {
+        return wtl::mean(v);
+    }, 1000u, 42u);
+    WTL_ASSERT(mean_dist.size() == 1000u);
+    // close to the analytic standard error
+    WTL_ASSERT(std::abs(wtl::sd(mean_dist) / wtl::sem(x) - 1.0) < 0.2);
+    const auto ci = wtl::percentile_interval(mean_dist);
+    std::cout << "mean: " << wtl::mean(x) << " " << ci.first << " " << ci.second << "\n";
+    WTL_ASSERT(ci.first < wtl::mean(x) && wtl::mean(x) < ci.second);
+    // independent of the number of workers
+    wtl::ThreadPool single(1);
+    const auto median_stat = [](std::vector<double>& v) {return wtl::median(&v);};
+    WTL_ASSERT(wtl::bootstrap(pool, x, median_stat, 300u, 7u)
+               == wtl::bootstrap(single, x, median_stat, 300u, 7u));
+    const auto index_dist = wtl::bootstrap_indices(pool, x.size(), [&x](const std::vector<size_t>& indices) {
+        double s = 0.0;
+        for (const auto i: indices) {s += x[i];}
+        return s / static_cast<double>(indices.size());
+    }, 1000u, 42u);
+    WTL_ASSERT(index_dist == mean_dist);
+    std::vector<double> single_value{3.0};
+    WTL_ASSERT(wtl::quantile(&single_value, 0.9) == 3.0);
+    WTL_ASSERT(wtl::percentile_interval(single_value) == std::make_pair(3.0, 3.0));
+    for (const auto& args: std::vector<std::pair<std::vector<double>, double>>{
+             {{}, 0.95}, {mean_dist, 0.0}, {mean_dist, 1.0}, {mean_dist, -0.5}, {mean_dist, std::nan("")}}) {
+        bool caught = false;
+        try {wtl::percentile_interval(args.first, args.second);}
+        catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+    for (const auto& args: std::vector<std::pair<std::vector<double>, double>>{
+             {{}, 0.5}, {single_value, -0.1}, {single_value, 1.1}}) {
+        auto v = args.first;
+        bool caught = false;
+        try {wtl::quantile(&v, args.second);}
+        catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+}
+
+inline void test_permutation(wtl::ThreadPool& pool) {
+    std::normal_distribution<double> normal(0.0, 1.0);
+    std::vector<double> x(100), y(100), z(100);
+    for (size_t i=0; i<x.size(); ++i) {
+        x[i] = normal(wtl::mt64());
+        y[i] = x[i] + 0.5 * normal(wtl::mt64());
+        z[i] = normal(wtl::mt64());
+    }
+    const auto cor = [](const std::vector<double>& a, const std::vector<double>& b) {
+        return wtl::cor_spearman(a, b);
+    };
+    const auto dependent = wtl::permutation_test_paired(pool, x, y, cor, 999u, 1u);
+    WTL_ASSERT(dependent.p_greater() == 0.001);
+    const auto ci = wtl::percentile_interval(wtl::bootstrap(pool, x, y, cor, 500u, 1u));
+    std::cout << "cor: " << dependent.observed() << " " << ci.first << " " << ci.second << "\n";
+    WTL_ASSERT(ci.first < dependent.observed() && dependent.observed() < ci.second);
+    const auto diff = [](const std::vector<double>& a, const std::vector<double>& b) {
+        return wtl::mean(a) - wtl::mean(b);
+    };
+    for (auto& z_i: z) {z_i += 1.0;}
+    const auto shifted = wtl::permutation_test(pool, x, z, diff, 999u, 2u);
+    std::cout << "diff: " << shifted.observed() << " p=" << shifted.p_two_sided() << "\n";
+    WTL_ASSERT(shifted.p_less() < 0.01);
+    WTL_ASSERT(shifted.p_two_sided() < 0.02);
+}
+
+int main() {
+    wtl::ThreadPool pool(4);
+    test_bootstrap(pool);
+    test_permutation(pool);
+    return 0;
+}
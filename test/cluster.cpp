@@ -2,6 +2,8 @@
 #include <wtl/random.hpp>
 #include <wtl/iostr.hpp>
 #include <wtl/signed.hpp>
+#include <wtl/concurrent.hpp>
+#include <wtl/exception.hpp>
 
 template <class T> inline
 void write(std::ostream& ost, const std::vector<T>& points, const std::vector<ptrdiff_t>& labels) {
@@ -22,7 +24,344 @@ std::vector<T> make_points(const ptrdiff_t n) {
     return points;
 }
 
+inline void test_pdist() {
+    const auto points = make_points<std::valarray<double>>(300);
+    const auto matrix = wtl::cluster::as_matrix(points);
+    const auto dist = wtl::cluster::pdist(matrix, wtl::cluster::Euclidean{}, 16u);
+    WTL_ASSERT(dist.size() == 300u * 299u / 2u);
+    for (size_t k=0; k<dist.size(); ++k) {
+        const auto ij = dist.pair(k);
+        WTL_ASSERT(ij.first < ij.second && dist.index(ij.first, ij.second) == k);
+        const double expected = wtl::cluster::euclidean_distance(points[ij.first], points[ij.second]);
+        WTL_ASSERT(std::abs(dist.values()[k] - expected) < 1e-12);
+        WTL_ASSERT(dist(ij.second, ij.first) == dist.values()[k]);
+    }
+    WTL_ASSERT(dist(5u, 5u) == 0.0);
+    wtl::ThreadPool pool(3);
+    WTL_ASSERT(wtl::cluster::pdist(pool, matrix, wtl::cluster::Euclidean{}, 16u).values() == dist.values());
+    for (const bool parallel: {false, true}) {
+        bool caught = false;
+        try {
+            if (parallel) {wtl::cluster::pdist(pool, matrix, wtl::cluster::Euclidean{}, 0u);}
+            else {wtl::cluster::pdist(matrix, wtl::cluster::Euclidean{}, 0u);}
+        } catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+    const auto manhattan = wtl::cluster::pdist(pool, matrix, wtl::cluster::Manhattan{});
+    WTL_ASSERT(std::abs(manhattan(3u, 7u) - wtl::cluster::Manhattan{}(points[3u], points[7u])) < 1e-12);
+    const auto sq = wtl::cluster::pdist(matrix, wtl::cluster::SquaredEuclidean{});
+    WTL_ASSERT(std::abs(sq(1u, 2u) - dist(1u, 2u) * dist(1u, 2u)) < 1e-12);
+    wtl::Matrix<double> genotypes(3u, 4u);
+    genotypes(1u, 0u) = 1.0;
+    genotypes(2u, 0u) = 1.0;
+    genotypes(2u, 3u) = 2.0;
+    const auto hamming = wtl::cluster::pdist(genotypes, wtl::cluster::Hamming{});
+    WTL_ASSERT(hamming.values() == (std::vector<double>{1.0, 2.0, 1.0}));
+    WTL_ASSERT(wtl::cluster::DistanceMatrix(1u).size() == 0u);
+}
+
+inline double medoid_cost(const wtl::cluster::DistanceMatrix& dist, const std::vector<ptrdiff_t>& medoids) {
+    double cost = 0.0;
+    for (size_t o=0; o<dist.n(); ++o) {
+        double d = std::numeric_limits<double>::max();
+        for (const auto m: medoids) {d = std::min(d, dist(o, static_cast<size_t>(m)));}
+        cost += d;
+    }
+    return cost;
+}
+
+inline void test_fastpam() {
+    const auto points = make_points<std::array<double, 2>>(80);
+    const auto dist = wtl::cluster::pdist(wtl::cluster::as_matrix(points));
+    const wtl::cluster::FastPAM fast(dist, 4);
+    const auto& medoids = fast.medoids();
+    WTL_ASSERT(medoids.size() == 4u);
+    WTL_ASSERT(std::abs(fast.cost() - medoid_cost(dist, medoids)) < 1e-9);
+    // no single swap improves the result
+    for (size_t i=0; i<medoids.size(); ++i) {
+        for (ptrdiff_t c=0; c<80; ++c) {
+            auto swapped = medoids;
+            swapped[i] = c;
+            WTL_ASSERT(medoid_cost(dist, swapped) >= fast.cost() - 1e-9);
+        }
+    }
+    for (size_t o=0; o<dist.n(); ++o) {
+        const auto label = static_cast<size_t>(fast.labels()[o]);
+        for (const auto m: medoids) {
+            WTL_ASSERT(dist(o, static_cast<size_t>(medoids[label])) <= dist(o, static_cast<size_t>(m)));
+        }
+    }
+    const auto from_points = wtl::cluster::fastpam(points, 4);
+    WTL_ASSERT(from_points.medoids() == medoids);
+}
+
+inline void test_parallel_pam() {
+    const auto points = make_points<std::valarray<double>>(500);
+    wtl::ThreadPool pool(3);
+    const auto serial = wtl::cluster::pam(points, 5, std::mt19937_64(24601u));
+    const auto parallel = wtl::cluster::pam(pool, points, 5, std::mt19937_64(24601u));
+    WTL_ASSERT(parallel.labels() == serial.labels());
+    WTL_ASSERT(parallel.medoids() == serial.medoids());
+}
+
+inline void test_clara() {
+    // well-separated blobs around 4 centers
+    std::normal_distribution<double> noise(0.0, 0.05);
+    std::mt19937_64 engine(42u);
+    const std::vector<std::array<double, 2>> centers{{{0.0, 0.0}}, {{1.0, 0.0}}, {{0.0, 1.0}}, {{1.0, 1.0}}};
+    std::vector<std::array<double, 2>> points;
+    for (int i=0; i<2000; ++i) {
+        const auto& c = centers[static_cast<size_t>(i % 4)];
+        points.push_back({{c[0] + noise(engine), c[1] + noise(engine)}});
+    }
+    wtl::ThreadPool pool(3);
+    const wtl::cluster::CLARA<> clara(points, 4, std::mt19937_64(1u));
+    const wtl::cluster::CLARA<> clara_parallel(pool, points, 4, std::mt19937_64(1u));
+    WTL_ASSERT(clara.medoids() == clara_parallel.medoids());
+    WTL_ASSERT(clara.labels() == clara_parallel.labels());
+    const wtl::cluster::CLARANS<> clarans(pool, points, 4, std::mt19937_64(2u));
+    for (const auto* labels: {&clara.labels(), &clarans.labels()}) {
+        // points of the same blob share a label
+        for (size_t i=4; i<points.size(); ++i) {
+            WTL_ASSERT((*labels)[i] == (*labels)[i % 4]);
+        }
+    }
+    std::cout << "CLARA cost: " << clara.cost() << ", CLARANS cost: " << clarans.cost() << "\n";
+    WTL_ASSERT(std::abs(clara.cost() / clarans.cost() - 1.0) < 0.05);
+    for (const ptrdiff_t k: {ptrdiff_t{0}, ptrdiff_t{-1}, static_cast<ptrdiff_t>(points.size()) + 1}) {
+        bool caught = false;
+        try {
+            const wtl::cluster::CLARANS<> invalid(points, k, std::mt19937_64(3u));
+        } catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+}
+
+inline void test_kmeans() {
+    std::normal_distribution<double> noise(0.0, 0.05);
+    std::mt19937_64 engine(24u);
+    const std::vector<std::valarray<double>> centers{{0.0, 0.0, 0.0}, {1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    std::vector<std::valarray<double>> points;
+    for (int i=0; i<4000; ++i) {
+        std::valarray<double> x = centers[static_cast<size_t>(i % 4)];
+        for (auto& v: x) {v += noise(engine);}
+        points.push_back(x);
+    }
+    const wtl::Matrix<double> matrix(points);
+    wtl::ThreadPool pool(3);
+    const wtl::cluster::KMeans serial(points, 4, std::mt19937_64(1u));
+    const wtl::cluster::KMeans parallel(pool, matrix, 4, std::mt19937_64(1u));
+    WTL_ASSERT(serial.labels() == parallel.labels());
+    WTL_ASSERT(serial.inertia() == parallel.inertia());
+    for (size_t i=4; i<points.size(); ++i) {
+        WTL_ASSERT(serial.labels()[i] == serial.labels()[i % 4]);
+    }
+    // about 3 * n * sigma^2
+    WTL_ASSERT(std::abs(serial.inertia() / (3.0 * 4000 * 0.0025) - 1.0) < 0.1);
+    // seeding never picks an existing center while others remain
+    std::vector<std::valarray<double>> repeated;
+    for (int i=0; i<300; ++i) {repeated.push_back({static_cast<double>(i % 3), 0.0});}
+    for (uint64_t seed=0u; seed<20u; ++seed) {
+        WTL_ASSERT(wtl::cluster::KMeans(repeated, 3, std::mt19937_64(seed)).inertia() == 0.0);
+    }
+
+    wtl::cluster::MiniBatchKMeans minibatch(4, std::mt19937_64(2u));
+    for (size_t begin=0; begin<points.size(); begin+=500u) {
+        const std::vector<std::valarray<double>> batch(points.begin() + static_cast<ptrdiff_t>(begin),
+                                                       points.begin() + static_cast<ptrdiff_t>(begin + 500u));
+        minibatch.partial_fit(pool, batch);
+    }
+    WTL_ASSERT(std::accumulate(minibatch.counts().begin(), minibatch.counts().end(), size_t{0u}) == points.size());
+    const auto labels = minibatch.predict(matrix);
+    for (size_t i=4; i<points.size(); ++i) {
+        WTL_ASSERT(labels[i] == labels[i % 4]);
+    }
+}
+
+template <class Metric> inline
+void test_ball_tree(Metric metric) {
+    std::mt19937_64 engine(7u);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    wtl::Matrix<double> points(3000u, 3u);
+    for (auto x = points.data(); x != points.data() + points.size(); ++x) {*x = uniform(engine);}
+    wtl::Matrix<double> queries(50u, 3u);
+    for (auto x = queries.data(); x != queries.data() + queries.size(); ++x) {*x = uniform(engine);}
+    const wtl::cluster::BallTree<Metric> tree(points, metric, 16u);
+    wtl::ThreadPool pool(3);
+    const auto knn = tree.knn_batch(pool, queries, 5u);
+    const auto within = tree.radius_batch(queries, 0.1);
+    for (size_t q=0; q<queries.nrow(); ++q) {
+        std::vector<wtl::cluster::Neighbor> brute;
+        for (size_t i=0; i<points.nrow(); ++i) {
+            brute.push_back({static_cast<ptrdiff_t>(i), metric(queries.row(q).data(), points.row(i).data(), 3u)});
+        }
+        std::sort(brute.begin(), brute.end());
+        WTL_ASSERT(knn[q].size() == 5u);
+        for (size_t i=0; i<5u; ++i) {
+            WTL_ASSERT(knn[q][i].index == brute[i].index);
+        }
+        const auto in_radius = std::count_if(brute.begin(), brute.end(),
+            [](const wtl::cluster::Neighbor& x) {return x.distance <= 0.1;});
+        WTL_ASSERT(wtl::ssize(within[q]) == in_radius);
+    }
+}
+
+// O(n^3) reference: merge the closest pair of active clusters each step
+inline std::vector<double> naive_heights(const wtl::cluster::DistanceMatrix& dist, wtl::cluster::Linkage method) {
+    const size_t n = dist.n();
+    std::vector<std::vector<double>> d(n, std::vector<double>(n));
+    for (size_t i=0; i<n; ++i) for (size_t j=0; j<n; ++j) d[i][j] = dist(i, j);
+    std::vector<double> sizes(n, 1.0);
+    std::vector<double> heights;
+    for (size_t step=0; step+1u<n; ++step) {
+        size_t x = 0u, y = 0u;
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i=0; i<n; ++i) for (size_t j=i+1u; j<n; ++j) {
+            if (sizes[i] > 0.0 && sizes[j] > 0.0 && d[i][j] < best) {best = d[i][j]; x = i; y = j;}
+        }
+        heights.push_back(best);
+        for (size_t k=0; k<n; ++k) {
+            if (sizes[k] == 0.0 || k == x || k == y) continue;
+            const double nk = sizes[k], nx = sizes[x], ny = sizes[y];
+            double v = 0.0;
+            switch (method) {
+              case wtl::cluster::Linkage::single: v = std::min(d[k][x], d[k][y]); break;
+              case wtl::cluster::Linkage::complete: v = std::max(d[k][x], d[k][y]); break;
+              case wtl::cluster::Linkage::average: v = (nx * d[k][x] + ny * d[k][y]) / (nx + ny); break;
+              case wtl::cluster::Linkage::ward:
+                v = std::sqrt(((nx + nk) * d[k][x] * d[k][x] + (ny + nk) * d[k][y] * d[k][y] - nk * best * best) / (nx + ny + nk));
+            }
+            d[k][y] = d[y][k] = v;
+        }
+        sizes[y] += sizes[x];
+        sizes[x] = 0.0;
+    }
+    std::sort(heights.begin(), heights.end());
+    return heights;
+}
+
+inline void test_linkage() {
+    const auto points = make_points<std::valarray<double>>(60);
+    const auto dist = wtl::cluster::pdist(wtl::cluster::as_matrix(points));
+    for (const auto method: {wtl::cluster::Linkage::single, wtl::cluster::Linkage::complete,
+                             wtl::cluster::Linkage::average, wtl::cluster::Linkage::ward}) {
+        const auto z = wtl::cluster::linkage(dist, method);
+        const auto expected = naive_heights(dist, method);
+        WTL_ASSERT(z.nrow() == 59u);
+        for (size_t i=0; i<z.nrow(); ++i) {
+            WTL_ASSERT(std::abs(z(i, 2u) - expected[i]) < 1e-12);
+            WTL_ASSERT(z(i, 0u) < z(i, 1u));
+            WTL_ASSERT(z(i, 1u) < 60.0 + static_cast<double>(i));
+        }
+        WTL_ASSERT(z(58u, 3u) == 60.0);
+        const auto labels = wtl::cluster::cut_tree(z, 5);
+        WTL_ASSERT(*std::max_element(labels.begin(), labels.end()) == 4);
+    }
+    // two distant groups
+    const std::vector<std::array<double, 1>> line{{{0.0}}, {{0.1}}, {{10.0}}, {{0.2}}, {{10.1}}};
+    const auto labels = wtl::cluster::cut_tree(wtl::cluster::linkage(line, wtl::cluster::Linkage::single), 2);
+    WTL_ASSERT((labels == std::vector<ptrdiff_t>{0, 0, 1, 0, 1}));
+}
+
+inline void test_dbscan() {
+    std::normal_distribution<double> noise(0.0, 0.05);
+    std::mt19937_64 engine(11u);
+    std::vector<std::array<double, 2>> points2;
+    std::vector<std::array<double, 5>> points5;
+    for (int i=0; i<3000; ++i) {
+        const double cx = static_cast<double>(i % 3);
+        points2.push_back({{cx + noise(engine), noise(engine)}});
+        points5.push_back({{cx + noise(engine), noise(engine), noise(engine), noise(engine), noise(engine)}});
+    }
+    // isolated noise points
+    points2.push_back({{10.0, 10.0}});
+    points5.push_back({{10.0, 10.0, 10.0, 10.0, 10.0}});
+    wtl::ThreadPool pool(4);
+    const wtl::cluster::DBSCAN<> grid(points2, 0.1, 5u);
+    const wtl::cluster::DBSCAN<> grid_parallel(pool, points2, 0.1, 5u);
+    const wtl::cluster::DBSCAN<> tree(pool, points5, 0.3, 5u);
+    const wtl::cluster::DBSCAN<wtl::cluster::Hamming> hamming(pool, points2, 0.5, 2u, wtl::cluster::Hamming{});
+    const wtl::cluster::DBSCAN<wtl::cluster::SquaredEuclidean> squared(pool, points5, 0.09, 5u);
+    WTL_ASSERT(grid.labels() == grid_parallel.labels());
+    WTL_ASSERT(squared.labels() == tree.labels());
+    for (const auto* result: {&grid, &tree}) {
+        const auto& labels = result->labels();
+        WTL_ASSERT(result->num_clusters() == 3);
+        WTL_ASSERT(labels.back() == -1);
+        WTL_ASSERT(!result->core().back());
+        for (size_t i=0; i<3u; ++i) {WTL_ASSERT(labels[i] == static_cast<ptrdiff_t>(i));}
+        for (size_t i=3; i+1u<labels.size(); ++i) {
+            WTL_ASSERT(labels[i] == -1 || labels[i] == labels[i % 3]);
+        }
+        WTL_ASSERT(std::count(labels.begin(), labels.end(), -1) < 30);
+    }
+    // all coordinates are distinct, so every point is noise
+    WTL_ASSERT(hamming.num_clusters() == 0);
+}
+
+inline void test_validity() {
+    std::normal_distribution<double> noise(0.0, 0.1);
+    std::mt19937_64 engine(5u);
+    const std::vector<std::array<double, 2>> centers{{{0.0, 0.0}}, {{2.0, 0.0}}, {{0.0, 2.0}}, {{2.0, 2.0}}};
+    std::vector<std::array<double, 2>> points;
+    std::vector<ptrdiff_t> labels;
+    for (int i=0; i<200; ++i) {
+        const auto c = static_cast<size_t>(i % 4);
+        points.push_back({{centers[c][0] + noise(engine), centers[c][1] + noise(engine)}});
+        labels.push_back(static_cast<ptrdiff_t>(c));
+    }
+    const auto matrix = wtl::cluster::as_matrix(points);
+    const auto dist = wtl::cluster::pdist(matrix);
+    wtl::ThreadPool pool(3);
+    const auto widths = wtl::cluster::silhouette_samples(dist, labels);
+    const auto widths_on_the_fly = wtl::cluster::silhouette_samples(pool, points, labels);
+    for (size_t i=0; i<points.size(); ++i) {
+        double a = 0.0, b = std::numeric_limits<double>::infinity();
+        for (ptrdiff_t c=0; c<4; ++c) {
+            double sum = 0.0;
+            for (size_t j=0; j<points.size(); ++j) {
+                if (labels[j] == c) sum += wtl::cluster::euclidean_distance(points[i], points[j]);
+            }
+            if (c == labels[i]) {a = sum / 49.0;} else {b = std::min(b, sum / 50.0);}
+        }
+        WTL_ASSERT(std::abs(widths[i] - (b - a) / std::max(a, b)) < 1e-12);
+        WTL_ASSERT(std::abs(widths_on_the_fly[i] - widths[i]) < 1e-12);
+    }
+    WTL_ASSERT(wtl::cluster::silhouette(pool, dist, labels) > 0.8);
+    std::vector<double> sizes;
+    const auto means = wtl::cluster::detail::centroids(matrix, labels, &sizes);
+    double inertia = 0.0;
+    for (size_t i=0; i<points.size(); ++i) {
+        inertia += wtl::cluster::SquaredEuclidean{}(matrix.row(i).data(), means.row(static_cast<size_t>(labels[i])).data(), 2u);
+    }
+    WTL_ASSERT(std::abs(wtl::cluster::within_dispersion(pool, dist, labels) / inertia - 1.0) < 1e-12);
+    WTL_ASSERT(wtl::cluster::davies_bouldin(points, labels) < 0.2);
+    // clusters 0 and 1 share the centroid (1, 0); that pair is skipped
+    const std::vector<std::array<double, 2>> coincident{
+        {{0.0, 0.0}}, {{2.0, 0.0}}, {{1.0, 1.0}}, {{1.0, -1.0}}, {{5.0, 0.0}}, {{7.0, 0.0}}};
+    const auto db = wtl::cluster::davies_bouldin(coincident, {0, 0, 1, 1, 2, 2});
+    WTL_ASSERT(std::abs(db - 0.4) < 1e-12);
+
+    const auto scores = wtl::cluster::sweep_k(pool, points, {2, 3, 4, 5, 6});
+    const auto best = std::max_element(scores.begin(), scores.end(),
+        [](const wtl::cluster::KScore& x, const wtl::cluster::KScore& y) {return x.silhouette < y.silhouette;});
+    WTL_ASSERT(best->k == 4);
+    for (size_t i=1; i<scores.size(); ++i) {
+        WTL_ASSERT(scores[i].within_dispersion < scores[i - 1u].within_dispersion);
+    }
+}
+
 int main(int argc, char* argv[]) {
+    test_pdist();
+    test_fastpam();
+    test_parallel_pam();
+    test_clara();
+    test_kmeans();
+    test_ball_tree(wtl::cluster::Euclidean{});
+    test_ball_tree(wtl::cluster::Manhattan{});
+    test_linkage();
+    test_dbscan();
+    test_validity();
     std::cout.precision(4);
     std::vector<std::string> arguments(argv + 1, argv + argc);
     const ptrdiff_t n = (arguments.size() > 0u) ? std::stol(arguments[0u]) : 20;
@@ -1,13 +1,323 @@
 #include <wtl/concurrent.hpp>
+#include <wtl/exception.hpp>
 
 #include <iostream>
 #include <sstream>
+#include <numeric>
+#include <string>
+#include <functional>
+#include <array>
 
 static_assert(!std::is_default_constructible_v<wtl::Task<void>>, "");
 static_assert(!std::is_copy_constructible_v<wtl::Task<void>>, "");
 static_assert(std::is_nothrow_move_constructible_v<wtl::Task<void>>, "");
+static_assert(!std::is_copy_constructible_v<wtl::UniqueFunction<void()>>, "");
+static_assert(std::is_nothrow_move_constructible_v<wtl::UniqueFunction<void()>>, "");
+
+inline void test_unique_function() {
+    auto owned = std::make_unique<int>(40);
+    wtl::UniqueFunction<int(int)> small([p = std::move(owned)](int x) {return *p + x;});
+    WTL_ASSERT(small(2) == 42);
+    std::array<double, 32> big{};
+    big[31] = 1.5;
+    wtl::UniqueFunction<double()> large([big]{return big[31];});
+    auto moved = std::move(large);
+    WTL_ASSERT(!large);
+    WTL_ASSERT(moved() == 1.5);
+    moved = []{return 2.5;};
+    WTL_ASSERT(moved() == 2.5);
+    moved = nullptr;
+    WTL_ASSERT(!moved);
+}
+
+template <class Pool> inline
+void test_submit_temporary(Pool& pool) {
+    std::vector<std::future<size_t>> futures;
+    for (size_t i=0; i<100u; ++i) {
+        futures.push_back(pool.submit([data = std::vector<size_t>(64u, i)](size_t x) {
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            return data[63] + x;
+        }, i));
+    }
+    for (size_t i=0; i<futures.size(); ++i) {WTL_ASSERT(futures[i].get() == 2u * i);}
+}
+
+template <class Pool> inline
+void test_submit_detached(Pool& pool) {
+    std::atomic<int64_t> sum{0};
+    for (int64_t i=0; i<100000; ++i) {
+        pool.submit_detached([&sum](int64_t x) {sum += x;}, i);
+    }
+    auto counter = std::make_unique<std::atomic<int>>(0);
+    pool.submit_detached([c = counter.get(), guard = std::make_unique<int>(1)]{*c += *guard;});
+    pool.wait();
+    WTL_ASSERT(sum.load() == int64_t{99999} * 100000 / 2);
+    WTL_ASSERT(counter->load() == 1);
+}
+
+inline void test_queues() {
+    constexpr int64_t per_producer = 50000;
+    wtl::MpmcQueue<int64_t> mpmc(100);
+    WTL_ASSERT(mpmc.capacity() == 128u);
+    std::atomic<int64_t> sum{0};
+    std::vector<std::thread> threads;
+    for (int t=0; t<3; ++t) {
+        threads.emplace_back([&mpmc]{
+            for (int64_t i=1; i<=per_producer; ++i) {mpmc.push(i);}
+        });
+        threads.emplace_back([&mpmc, &sum]{
+            int64_t local = 0;
+            for (int64_t i=0; i<per_producer; ++i) {local += mpmc.pop();}
+            sum += local;
+        });
+    }
+    for (auto& th: threads) {th.join();}
+    WTL_ASSERT(sum.load() == 3 * per_producer * (per_producer + 1) / 2);
+    int64_t x = 0;
+    WTL_ASSERT(!mpmc.try_pop(&x));
+    std::vector<int64_t> many(200u, 1);
+    WTL_ASSERT(mpmc.try_push_n(many.begin(), many.size()) == 128u);
+    WTL_ASSERT(mpmc.try_pop_n(many.begin(), 200u) == 128u);
+
+    // order is preserved across batch and single operations
+    wtl::SpscRing<int64_t> spsc(64);
+    std::thread producer([&spsc]{
+        std::vector<int64_t> batch(10u);
+        for (int64_t i=0; i<100000; i+=10) {
+            std::iota(batch.begin(), batch.end(), i);
+            spsc.push_n(batch.begin(), batch.size());
+        }
+        spsc.push(int64_t{-1});
+    });
+    std::vector<int64_t> received;
+    spsc.pop_n(std::back_inserter(received), 99990u);
+    for (int64_t i=0; i<10; ++i) {received.push_back(spsc.pop());}
+    WTL_ASSERT(spsc.pop() == -1);
+    producer.join();
+    WTL_ASSERT(!spsc.try_pop(&x));
+    for (size_t i=0; i<received.size(); ++i) {WTL_ASSERT(received[i] == static_cast<int64_t>(i));}
+}
+
+template <class Pool> inline
+void test_bulk(Pool& pool) {
+    std::vector<int> inputs(1000);
+    std::iota(inputs.begin(), inputs.end(), 0);
+    auto futures = pool.submit_bulk(inputs, [](int x) {return 2 * x;});
+    WTL_ASSERT(futures.size() == inputs.size());
+    for (size_t i=0; i<futures.size(); ++i) {WTL_ASSERT(futures[i].get() == 2 * inputs[i]);}
+    {
+        // the temporary callable and its captured data are gone before get()
+        std::vector<std::future<int>> later;
+        {
+            later = pool.submit_bulk(inputs, [factor = std::vector<int>(32, 3)](int x) {
+                std::this_thread::sleep_for(std::chrono::microseconds(5));
+                return factor[31] * x;
+            });
+        }
+        for (size_t i=0; i<later.size(); ++i) {WTL_ASSERT(later[i].get() == 3 * inputs[i]);}
+        const auto mapped = wtl::parallel_map(pool, inputs, [factor = std::vector<int>(32, 5)](int x) {
+            return factor[31] * x;
+        }, 4u);
+        WTL_ASSERT(mapped[999] == 5 * 999);
+    }
+
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    auto slow_square = [&running, &peak](int x) {
+        const int now = ++running;
+        int expected = peak.load();
+        while (now > expected && !peak.compare_exchange_weak(expected, now)) {}
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        --running;
+        return static_cast<int64_t>(x) * x;
+    };
+    int64_t previous = -1;
+    wtl::parallel_map(pool, inputs.begin(), inputs.end(), slow_square,
+        [&previous](int64_t y) {WTL_ASSERT(y > previous); previous = y;}, 3u);
+    WTL_ASSERT(previous == 999 * 999);
+    WTL_ASSERT(peak.load() <= 3);
+    const auto squares = wtl::parallel_map(pool, inputs, slow_square);
+    WTL_ASSERT(squares.size() == inputs.size());
+    WTL_ASSERT(squares[10] == 100);
+    bool caught = false;
+    try {
+        wtl::parallel_map(pool, inputs, [](int x) {if (x == 7) throw std::domain_error("7"); return x;});
+    } catch (const std::domain_error&) {caught = true;}
+    WTL_ASSERT(caught);
+}
+
+template <class Pool> inline
+void test_task_graph(Pool& pool) {
+    // simulate -> summarize (x4) -> cluster -> write
+    std::vector<int> data(4);
+    std::vector<int> summaries(4);
+    int clustered = 0;
+    std::vector<int> written;
+    wtl::TaskGraph graph;
+    const auto simulate = graph.add([&data]{std::iota(data.begin(), data.end(), 1);});
+    std::vector<size_t> summarize;
+    for (size_t i=0; i<4u; ++i) {
+        summarize.push_back(graph.then(simulate, [&data, &summaries, i]{
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            summaries[i] = data[i] * 10;
+        }));
+    }
+    const auto cluster = graph.add([&summaries, &clustered]{
+        clustered = std::accumulate(summaries.begin(), summaries.end(), 0);
+    }, summarize);
+    graph.then(cluster, [&clustered, &written]{written.push_back(clustered);});
+    WTL_ASSERT(graph.size() == 7u);
+    WTL_ASSERT(graph.successors(simulate) == summarize);
+    // a single worker is enough because no task blocks
+    graph.run(pool);
+    graph.run(pool);
+    WTL_ASSERT((written == std::vector<int>{100, 100}));
+    for (const auto node: summarize) {
+        WTL_ASSERT(graph.timing(node).start >= graph.timing(simulate).finish);
+        WTL_ASSERT(graph.timing(cluster).start >= graph.timing(node).finish);
+        WTL_ASSERT(graph.timing(node).duration() >= std::chrono::milliseconds(5));
+    }
+
+    wtl::TaskGraph failing;
+    bool after_ran = false;
+    const auto bad = failing.add([]{throw std::runtime_error("node");});
+    failing.then(bad, [&after_ran]{after_ran = true;});
+    bool caught = false;
+    try {failing.run(pool);} catch (const std::runtime_error&) {caught = true;}
+    WTL_ASSERT(caught);
+    WTL_ASSERT(!after_ran);
+    bool thrown = false;
+    try {failing.add([]{}, {5u});} catch (const std::invalid_argument&) {thrown = true;}
+    WTL_ASSERT(thrown);
+}
+
+inline void test_topology() {
+    WTL_ASSERT((wtl::detail::parse_cpulist("0-3,8,10-11") == std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    WTL_ASSERT((wtl::detail::parse_cpulist("0,2-3") == std::vector<int>{0, 2, 3}));
+    const auto cpus = wtl::usable_cpus();
+    WTL_ASSERT(!cpus.empty());
+    const int n = wtl::hardware_concurrency();
+    WTL_ASSERT(1 <= n && n <= static_cast<int>(cpus.size()));
+    size_t grouped = 0u;
+    for (const auto& node: wtl::numa_nodes()) {
+        for (const int cpu: node) {WTL_ASSERT(std::find(cpus.begin(), cpus.end(), cpu) != cpus.end());}
+        grouped += node.size();
+    }
+    WTL_ASSERT(grouped == cpus.size());
+    std::cout << "usable CPUs: " << cpus.size() << ", hardware_concurrency: " << n << "\n";
+
+    wtl::ThreadPool pinned(2, wtl::Affinity::core);
+#ifdef __linux__
+    for (auto& f: pinned.submit_bulk(std::vector<int>(8), [](int) {return sched_getcpu();})) {
+        const int cpu = f.get();
+        WTL_ASSERT(cpu == cpus[0] || cpu == cpus[1u % cpus.size()]);
+    }
+#endif
+    wtl::NumaThreadPool numa(2);
+    WTL_ASSERT(numa.size() == 2 * static_cast<int>(numa.num_nodes()));
+    std::atomic<int> count{0};
+    wtl::parallel_for(numa, 0, 1000, 10, [&count](int) {++count;});
+    numa.submit_detached([&count]{count += 1000;});
+    numa.wait();
+    WTL_ASSERT(count.load() == 2000);
+}
+
+// binary tree of tasks submitted from inside tasks
+struct Spawner {
+    wtl::WorkStealingPool* pool;
+    std::atomic<int>* leaves;
+    int depth;
+    void operator()() const {
+        if (depth == 0) {
+            ++*leaves;
+            return;
+        }
+        pool->submit(Spawner{pool, leaves, depth - 1});
+        pool->submit(Spawner{pool, leaves, depth - 1});
+    }
+};
+
+inline void test_work_stealing() {
+    wtl::WorkStealingPool pool(4);
+    WTL_ASSERT(pool.size() == 4);
+    auto square = [](const int64_t i) {return i * i;};
+    std::vector<std::future<int64_t>> futures;
+    for (int64_t i=0; i<20000; ++i) {
+        futures.push_back(pool.submit(square, i));
+    }
+    int64_t sum = 0;
+    for (auto& f: futures) {sum += f.get();}
+    WTL_ASSERT(sum == int64_t{19999} * 20000 * 39999 / 6);
+    std::atomic<int> leaves{0};
+    for (int repeat=0; repeat<3; ++repeat) {
+        leaves = 0;
+        pool.submit(Spawner{&pool, &leaves, 14});
+        pool.wait();
+        WTL_ASSERT(leaves.load() == (1 << 14));
+    }
+    // temporary callables are copied into the task
+    std::vector<std::future<int>> temporaries;
+    for (int i=0; i<100; ++i) {
+        temporaries.push_back(pool.submit([offset = std::vector<int>(64, i)](int x) {return offset[63] + x;}, 1));
+    }
+    for (int i=0; i<100; ++i) {WTL_ASSERT(temporaries[static_cast<size_t>(i)].get() == i + 1);}
+    auto thrower = [](int){throw std::runtime_error("task");};
+    auto ftr = pool.submit(thrower, 0);
+    bool caught = false;
+    try {ftr.get();} catch (const std::runtime_error&) {caught = true;}
+    WTL_ASSERT(caught);
+}
+
+template <class Pool> inline
+void test_parallel_loops(Pool& pool) {
+    for (const auto schedule: {wtl::Schedule::fixed, wtl::Schedule::dynamic, wtl::Schedule::guided}) {
+        std::vector<std::atomic<int>> hits(10007u);
+        wtl::parallel_for(pool, size_t{0u}, hits.size(), size_t{16u}, [&hits](size_t i) {++hits[i];}, schedule);
+        for (const auto& x: hits) {WTL_ASSERT(x.load() == 1);}
+        const auto sum = wtl::parallel_reduce(pool, int64_t{-500}, int64_t{1000}, int64_t{7}, int64_t{0},
+            [](int64_t i) {return i;}, std::plus<int64_t>{}, schedule);
+        WTL_ASSERT(sum == 374250);
+        // non-commutative reduction keeps index order
+        const auto joined = wtl::parallel_reduce(pool, 0, 30, 4, std::string{},
+            [](int i) {return std::string(1, static_cast<char>('a' + i % 26));},
+            [](std::string a, const std::string& b) {return a + b;}, schedule);
+        WTL_ASSERT(joined == "abcdefghijklmnopqrstuvwxyzabcd");
+        std::vector<double> x(1000u), y(1000u);
+        std::iota(x.begin(), x.end(), 0.0);
+        const auto end = wtl::parallel_transform(pool, x.cbegin(), x.cend(), y.begin(), 10, [](double v) {return 2.0 * v;}, schedule);
+        WTL_ASSERT(end == y.end());
+        WTL_ASSERT(y[999u] == 1998.0);
+        bool caught = false;
+        try {
+            wtl::parallel_for(pool, 0, 1000, 1, [](int i) {if (i == 500) throw std::out_of_range("500");}, schedule);
+        } catch (const std::out_of_range&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+    wtl::parallel_for(pool, 5, 5, 1, [](int) {throw std::logic_error("empty range");});
+}
 
 int main() {
+    test_unique_function();
+    test_queues();
+    test_topology();
+    test_work_stealing();
+    {
+        wtl::ThreadPool thread_pool(3);
+        test_parallel_loops(thread_pool);
+        wtl::WorkStealingPool stealing_pool(3);
+        test_parallel_loops(stealing_pool);
+        wtl::SerialPool serial_pool;
+        test_parallel_loops(serial_pool);
+        test_submit_temporary(serial_pool);
+        test_submit_temporary(thread_pool);
+        test_submit_detached(thread_pool);
+        test_submit_detached(stealing_pool);
+        test_bulk(thread_pool);
+        test_bulk(stealing_pool);
+        wtl::ThreadPool single(1);
+        test_task_graph(single);
+        test_task_graph(stealing_pool);
+    }
     wtl::ThreadPool pool(2);
     std::vector<std::future<int>> futures;
     for (int j=0; j < 2; ++j) {
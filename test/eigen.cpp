@@ -1,5 +1,6 @@
 #include <wtl/eigen.hpp>
 #include <wtl/exception.hpp>
+#include <wtl/math.hpp>
 
 void constructors() {
   std::vector<int> v{0, 1, 2};
@@ -11,7 +12,16 @@ void constructors() {
   WTL_ASSERT(row_vec.size() == 3);
 }
 
+void simd_kernels() {
+  Eigen::ArrayXd x = Eigen::ArrayXd::LinSpaced(5, -1.0, 1.0);
+  const Eigen::ArrayXd y = wtl::simd::exp(x);
+  WTL_ASSERT(((y - x.exp()).abs() < 1e-15).all());
+  wtl::simd::tanh(&x);
+  WTL_ASSERT(std::abs(x[0] - std::tanh(-1.0)) < 1e-15);
+}
+
 int main() {
   constructors();
+  simd_kernels();
   return 0;
 }
@@ -1,5 +1,218 @@
 #include <wtl/math.hpp>
+#include <wtl/numeric.hpp>
 #include <wtl/exception.hpp>
+#include <wtl/chrono.hpp>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+inline double ulp_error(double x, double y) {
+    if (x == y || (std::isnan(x) && std::isnan(y))) return 0.0;
+    if (!std::isfinite(x) || !std::isfinite(y)) return std::numeric_limits<double>::infinity();
+    const double ulp = std::nextafter(std::abs(y), std::numeric_limits<double>::infinity()) - std::abs(y);
+    return std::abs(x - y) / ulp;
+}
+
+template <class Kernel, class Reference> inline
+double max_ulp_error(const std::vector<double>& x, Kernel kernel, Reference reference) {
+    std::vector<double> y(x.size());
+    kernel(x.data(), y.data(), x.size());
+    double max_error = 0.0;
+    for (size_t i=0; i<x.size(); ++i) {
+        max_error = std::max(max_error, ulp_error(y[i], reference(x[i])));
+    }
+    return max_error;
+}
+
+inline std::vector<double> runif(size_t n, double lower, double upper) {
+    std::mt19937_64 engine(42u);
+    std::uniform_real_distribution<double> uniform(lower, upper);
+    std::vector<double> x(n);
+    for (auto& x_i: x) {x_i = uniform(engine);}
+    return x;
+}
+
+inline std::vector<double> rlogunif(size_t n, double lower, double upper) {
+    auto x = runif(n, lower, upper);
+    for (auto& x_i: x) {x_i = std::exp2(x_i);}
+    return x;
+}
+
+inline void test_simd() {
+    namespace simd = wtl::simd;
+    const size_t n = 200000u;
+    const auto wide = runif(n, -745.0, 710.0);
+    const auto narrow = runif(n, -20.0, 20.0);
+    const auto positive = rlogunif(n, -1074.0, 1024.0);
+    const auto small = runif(n, -0.999, 1.0);
+    const double e_exp = std::max(
+      max_ulp_error(wide, [](auto... a) {simd::exp(a...);}, [](double x) {return std::exp(x);}),
+      max_ulp_error(narrow, [](auto... a) {simd::exp(a...);}, [](double x) {return std::exp(x);}));
+    const double e_expm1 = std::max(
+      max_ulp_error(narrow, [](auto... a) {simd::expm1(a...);}, [](double x) {return std::expm1(x);}),
+      max_ulp_error(small, [](auto... a) {simd::expm1(a...);}, [](double x) {return std::expm1(x);}));
+    const double e_log = max_ulp_error(positive, [](auto... a) {simd::log(a...);}, [](double x) {return std::log(x);});
+    const double e_log1p = max_ulp_error(small, [](auto... a) {simd::log1p(a...);}, [](double x) {return std::log1p(x);});
+    const double e_sigmoid = max_ulp_error(narrow, [](auto... a) {simd::sigmoid(a...);}, [](double x) {return wtl::sigmoid(x);});
+    const double e_tanh = std::max(
+      max_ulp_error(narrow, [](auto... a) {simd::tanh(a...);}, [](double x) {return std::tanh(x);}),
+      max_ulp_error(small, [](auto... a) {simd::tanh(a...);}, [](double x) {return std::tanh(x);}));
+    std::cout << "ulp error: exp " << e_exp << ", expm1 " << e_expm1
+              << ", log " << e_log << ", log1p " << e_log1p
+              << ", sigmoid " << e_sigmoid << ", tanh " << e_tanh << "\n";
+    // the bounds documented in wtl/math.hpp
+    WTL_ASSERT(e_exp <= 1.0);
+    WTL_ASSERT(e_expm1 <= 2.0);
+    WTL_ASSERT(e_log <= 2.0);
+    WTL_ASSERT(e_log1p <= 2.0);
+    WTL_ASSERT(e_sigmoid <= 2.0);
+    WTL_ASSERT(e_tanh <= 4.0);
+
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+    const std::vector<double> special{0.0, -0.0, 1.0, inf, -inf, nan, -1.0, 1e-310};
+    const auto e = simd::exp(special);
+    WTL_ASSERT(e[0] == 1.0 && e[3] == inf && e[4] == 0.0 && std::isnan(e[5]));
+    const auto l = simd::log(special);
+    WTL_ASSERT(l[0] == -inf && l[2] == 0.0 && l[3] == inf && std::isnan(l[5]) && std::isnan(l[6]));
+    WTL_ASSERT(std::abs(l[7] - std::log(1e-310)) < 1e-12);
+    WTL_ASSERT(simd::log1p(std::vector<double>{-1.0})[0] == -inf);
+    const auto t = simd::tanh(special);
+    WTL_ASSERT(t[3] == 1.0 && t[4] == -1.0 && t[6] == std::tanh(-1.0));
+
+    std::valarray<double> va{1000.0, 1000.0};
+    WTL_ASSERT(std::abs(simd::logsumexp(va) - (1000.0 + std::log(2.0))) < 1e-12);
+    simd::sigmoid(&va, 0.0);
+    WTL_ASSERT(va[0] == 0.5);
+    WTL_ASSERT(simd::logsumexp(std::vector<double>{}) == -inf);
+}
+
+// Timing only; the speedup depends on -march and is not asserted.
+template <class Kernel, class Reference> inline
+void benchmark_kernel(const char* name, const std::vector<double>& x, Kernel kernel, Reference reference) {
+    std::vector<double> y(x.size());
+    const auto scalar = wtl::stopwatch<std::chrono::microseconds>([&] {
+        for (int rep=0; rep<10; ++rep) {
+            for (size_t i=0; i<x.size(); ++i) {y[i] = reference(x[i]);}
+        }
+    });
+    const double check = y[x.size() / 2u];
+    const auto vector = wtl::stopwatch<std::chrono::microseconds>([&] {
+        for (int rep=0; rep<10; ++rep) {kernel(x.data(), y.data(), x.size());}
+    });
+    WTL_ASSERT(ulp_error(y[x.size() / 2u], check) <= 4.0);
+    std::cout << name << ": libm " << scalar.count() << " us, simd "
+              << vector.count() << " us, speedup "
+              << static_cast<double>(scalar.count()) / static_cast<double>(std::max<int64_t>(vector.count(), 1))
+              << "\n";
+}
+
+inline void benchmark_simd() {
+    namespace simd = wtl::simd;
+    const auto x = runif(size_t{1u} << 20u, -20.0, 20.0);
+    const auto positive = runif(size_t{1u} << 20u, 1e-3, 1e3);
+    benchmark_kernel("exp", x, [](auto... a) {simd::exp(a...);}, [](double v) {return std::exp(v);});
+    benchmark_kernel("log", positive, [](auto... a) {simd::log(a...);}, [](double v) {return std::log(v);});
+    benchmark_kernel("sigmoid", x, [](auto... a) {simd::sigmoid(a...);}, [](double v) {return wtl::sigmoid(v);});
+    benchmark_kernel("tanh", x, [](auto... a) {simd::tanh(a...);}, [](double v) {return std::tanh(v);});
+}
+
+inline void test_combinatorics() {
+    static_assert(wtl::choose(int64_t{30}, int64_t{15}) == 155117520);
+    WTL_ASSERT(wtl::choose_runtime(5, 2) == 10);
+    WTL_ASSERT(wtl::choose_runtime(5, 0) == 1);
+    WTL_ASSERT(wtl::choose_runtime(5, 6) == 0);
+    WTL_ASSERT(wtl::permut_runtime(5, 0) == 1);
+    WTL_ASSERT(wtl::permut_runtime(5, 2) == 20);
+    WTL_ASSERT(wtl::choose_runtime(int64_t{62}, int64_t{31}) == 465428353255261088);
+    WTL_ASSERT(wtl::choose_runtime(uint64_t{67}, uint64_t{33}) == 14226520737620288370u);
+    bool thrown = false;
+    try {
+        wtl::choose_runtime(int64_t{68}, int64_t{34});
+    } catch (const std::overflow_error&) {
+        thrown = true;
+    }
+    WTL_ASSERT(thrown);
+    WTL_ASSERT(wtl::log_factorial(0) == 0.0);
+    WTL_ASSERT(wtl::log_factorial(1) == 0.0);
+    WTL_ASSERT(std::abs(wtl::log_factorial(20) - std::log(2432902008176640000.0)) < 1e-13);
+    for (const int64_t n: {1000, 65536, 65537, 100000, 3000000}) {
+        const double expected = std::lgamma(static_cast<double>(n) + 1.0);
+        WTL_ASSERT(std::abs(wtl::log_factorial(n) / expected - 1.0) < 1e-14);
+    }
+    WTL_ASSERT(std::abs(wtl::log_choose(62, 31) - std::log(465428353255261088.0)) < 1e-12);
+    WTL_ASSERT(std::abs(wtl::log_permut(5, 2) - std::log(20.0)) < 1e-14);
+    WTL_ASSERT(wtl::log_choose(5u, 5u) == 0.0);
+    for (const auto& args: std::vector<std::pair<int, int>>{{-1, 0}, {5, -1}, {5, 6}}) {
+        bool caught = false;
+        try {
+            wtl::log_choose(args.first, args.second);
+        } catch (const std::invalid_argument&) {
+            caught = true;
+        }
+        WTL_ASSERT(caught);
+        caught = false;
+        try {
+            wtl::log_permut(args.first, args.second);
+        } catch (const std::invalid_argument&) {
+            caught = true;
+        }
+        WTL_ASSERT(caught);
+    }
+    thrown = false;
+    try {
+        wtl::log_factorial(-1);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    WTL_ASSERT(thrown);
+    const std::vector<int> counts{2, 3, 5};
+    WTL_ASSERT(std::abs(wtl::log_multinomial(counts) - std::log(2520.0)) < 1e-12);
+}
+
+inline void test_tabulated() {
+    using Method = wtl::Tabulated::Method;
+    const wtl::Sigmoid sigmoid(2.0);
+    for (const auto method: {Method::linear, Method::cubic, Method::chebyshev}) {
+        const size_t n = (method == Method::chebyshev) ? 64u : 1024u;
+        const wtl::Tabulated table(sigmoid, -10.0, 10.0, n, method);
+        std::cout << "Tabulated error bound: " << table.error_bound() << "\n";
+        WTL_ASSERT(table.error_bound() < 1e-4);
+        const auto x = runif(10000u, -10.0, 10.0);
+        std::vector<double> y(x.size());
+        table(x.data(), y.data(), x.size());
+        for (size_t i=0; i<x.size(); ++i) {
+            WTL_ASSERT(std::abs(y[i] - sigmoid(x[i])) <= 2.0 * table.error_bound());
+            WTL_ASSERT(y[i] == table(x[i]));
+        }
+        WTL_ASSERT(table(-100.0) == table(-10.0));
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        WTL_ASSERT(std::isnan(table(nan)));
+        const std::valarray<double> with_nan{0.5, nan};
+        const auto y_nan = table(with_nan);
+        WTL_ASSERT(y_nan[0] == table(0.5) && std::isnan(y_nan[1]));
+    }
+    const double inf = std::numeric_limits<double>::infinity();
+    for (const auto& bounds: std::vector<std::pair<double, double>>{
+             {1.0, 1.0}, {1.0, 0.0}, {0.0, inf}, {-inf, 0.0}, {std::nan(""), 1.0}}) {
+        bool caught = false;
+        try {
+            wtl::Tabulated(sigmoid, bounds.first, bounds.second);
+        } catch (const std::invalid_argument&) {
+            caught = true;
+        }
+        WTL_ASSERT(caught);
+    }
+    const wtl::Tabulated cubic(sigmoid, -10.0, 10.0, 1024u);
+    WTL_ASSERT(cubic.error_bound() < 1e-7);
+    const wtl::Tabulated cheb([](double x) {return std::exp(-x * x);}, 0.0, 5.0, 48u, Method::chebyshev);
+    WTL_ASSERT(cheb.error_bound() < 1e-12);
+    const double expected = 0.5 * std::sqrt(3.14159265358979323846) * std::erf(5.0);
+    WTL_ASSERT(std::abs(wtl::integrate_adaptive(cheb, 0.0, 5.0) - expected) < 1e-12);
+    WTL_ASSERT(std::abs(wtl::integrate_adaptive_batch(cheb, 0.0, 5.0) - expected) < 1e-12);
+    WTL_ASSERT(std::abs(wtl::integrate(cheb, 0.0, 5.0, 1000) - expected) < 1e-10);
+}
 
 int main() {
     WTL_ASSERT(wtl::pow(2, 0) == 1);
@@ -13,5 +226,9 @@ int main() {
     WTL_ASSERT(wtl::factorial(5u) == 120u);
     WTL_ASSERT(wtl::permut(5u, 2u) == 20u);
     WTL_ASSERT(wtl::choose(5u, 2u) == 10u);
+    test_combinatorics();
+    test_simd();
+    benchmark_simd();
+    test_tabulated();
     return 0;
 }
@@ -1,4 +1,6 @@
 #include <wtl/numeric.hpp>
+#include <wtl/concurrent.hpp>
+#include <wtl/random.hpp>
 #include <wtl/exception.hpp>
 #include <wtl/iostr.hpp>
 
@@ -18,6 +20,29 @@ inline void test_integral() {
         wtl::integrate([](double x){return std::exp(- x * x);}, 0.0, 10.0)));
 }
 
+inline void test_integral_adaptive() {
+    constexpr double pi = 3.14159265358979323846;
+    double error = 0.0;
+    WTL_ASSERT(wtl::approx(2.0,
+        wtl::integrate_adaptive([](double x){return std::sin(x);}, 0.0, pi), 1e-14));
+    WTL_ASSERT(wtl::approx(2.0,
+        wtl::integrate_adaptive<wtl::gauss_kronrod_15>([](double x){return std::sin(x);}, 0.0, pi), 1e-14));
+    WTL_ASSERT(wtl::approx(pi / 4.0,
+        wtl::integrate_adaptive([](double x){return std::sqrt(1 - x * x);}, 0.0, 1.0,
+                                1e-10, 1e-10, 1000, &error), 1e-9));
+    WTL_ASSERT(error < 1e-9);
+    // sharply peaked
+    const double sigma = 1e-3;
+    const auto normal = [sigma](double x) {
+        return std::exp(-0.5 * x * x / (sigma * sigma)) / (sigma * std::sqrt(2.0 * pi));
+    };
+    WTL_ASSERT(wtl::approx(1.0, wtl::integrate_adaptive(normal, -1.0, 1.0), 1e-9));
+    WTL_ASSERT(wtl::approx(0.5 * std::sqrt(pi),
+        wtl::integrate_adaptive_batch([](const std::valarray<double>& x) {
+            return std::exp(- x * x);
+        }, 0.0, 10.0), 1e-12));
+}
+
 inline void test_valarray() {
     std::cout.precision(16);
     std::cout << wtl::lin_spaced(11) << std::endl;
@@ -26,8 +51,157 @@ inline void test_valarray() {
     std::cout << wtl::round(wtl::lin_spaced(51), 100) << std::endl;
 }
 
+inline void test_matrix() {
+    std::vector<std::valarray<int>> rows;
+    for (int i=0; i<37; ++i) {
+        std::valarray<int> row(45);
+        for (int j=0; j<45; ++j) {row[static_cast<size_t>(j)] = i * 100 + j;}
+        rows.push_back(row);
+    }
+    const wtl::Matrix<int> m(rows);
+    WTL_ASSERT(m.nrow() == 37u && m.ncol() == 45u);
+    WTL_ASSERT(m(3u, 4u) == 304);
+    WTL_ASSERT(m.col(4u)[3u] == 304);
+    WTL_ASSERT((wtl::row_sums(m) == wtl::row_sums(rows)).min());
+    WTL_ASSERT((wtl::col_sums(m) == wtl::col_sums(rows)).min());
+    const auto tm = wtl::transpose(m);
+    const auto trows = wtl::transpose(rows);
+    WTL_ASSERT(tm.nrow() == 45u && tm.ncol() == 37u);
+    for (size_t i=0; i<tm.nrow(); ++i) {
+        WTL_ASSERT(std::equal(tm.row(i).begin(), tm.row(i).end(), std::begin(trows[i])));
+    }
+    std::valarray<bool> odd(37);
+    for (size_t i=1; i<odd.size(); i+=2) {odd[i] = true;}
+    const auto view = wtl::filter(m, odd);
+    const auto filtered = wtl::filter(rows, odd);
+    WTL_ASSERT(view.nrow() == filtered.size());
+    WTL_ASSERT(view(2u, 5u) == filtered[2u][5u]);
+    WTL_ASSERT((wtl::col_sums(view) == wtl::col_sums(filtered)).min());
+    WTL_ASSERT((wtl::row_sums(view.copy()) == wtl::row_sums(filtered)).min());
+    WTL_ASSERT(view.copy().to_rows().size() == filtered.size());
+    const wtl::Matrix<int> no_cols(3u, 0u);
+    WTL_ASSERT(wtl::col_sums(no_cols).size() == 0u);
+    WTL_ASSERT(wtl::row_sums(no_cols).size() == 3u && wtl::row_sums(no_cols).max() == 0);
+    WTL_ASSERT(wtl::col_sums(wtl::Matrix<int>(0u, 0u)).size() == 0u);
+    bool caught = false;
+    try {wtl::filter(m, std::valarray<bool>(36));}
+    catch (const std::invalid_argument&) {caught = true;}
+    WTL_ASSERT(caught);
+    caught = false;
+    try {wtl::transpose(m, 0u);}
+    catch (const std::invalid_argument&) {caught = true;}
+    WTL_ASSERT(caught);
+    rows.back() = std::valarray<int>(44);
+    caught = false;
+    try {wtl::Matrix<int> ragged(rows);}
+    catch (const std::invalid_argument&) {caught = true;}
+    WTL_ASSERT(caught);
+}
+
+inline void test_histogram() {
+    const std::vector<int> keys{0, 1, 1, 3, 3, 3, -1, 7};
+    WTL_ASSERT((wtl::bincount(keys, 4u) == std::vector<ptrdiff_t>{1, 2, 0, 3}));
+    const std::vector<double> x{0.0, 0.1, 0.25, 0.5, 0.99, 1.0, 1.5, -0.1};
+    WTL_ASSERT((wtl::histogram(x, 4u, 0.0, 1.0) == std::vector<ptrdiff_t>{2, 1, 1, 2}));
+    WTL_ASSERT((wtl::histogram(x, {0.0, 0.25, 0.5, 1.0}) == std::vector<ptrdiff_t>{2, 1, 3}));
+    const double inf = std::numeric_limits<double>::infinity();
+    const std::vector<double> nonfinite{std::nan(""), inf, -inf, 1e300, -1e300, 0.5};
+    WTL_ASSERT((wtl::histogram(nonfinite, 2u, 0.0, 1.0) == std::vector<ptrdiff_t>{0, 1}));
+    WTL_ASSERT((wtl::histogram(nonfinite, {0.0, 0.5, 1.0}) == std::vector<ptrdiff_t>{0, 1}));
+    for (const auto& args: std::vector<std::tuple<size_t, double, double>>{
+             {0u, 0.0, 1.0}, {4u, 1.0, 1.0}, {4u, 1.0, 0.0}, {4u, 0.0, std::nan("")}, {4u, -inf, 0.0}}) {
+        bool caught = false;
+        try {
+            wtl::histogram(x, std::get<0>(args), std::get<1>(args), std::get<2>(args));
+        } catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+    for (const auto& edges: std::vector<std::vector<double>>{{0.0}, {0.0, 0.5, 0.5}, {0.0, 1.0, 0.5}}) {
+        bool caught = false;
+        try {
+            wtl::histogram(x, edges);
+        } catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+    std::vector<int> many(100000);
+    std::vector<double> uniform(many.size());
+    std::uniform_int_distribution<int> dist(-2, 40);
+    for (size_t i=0; i<many.size(); ++i) {
+        many[i] = dist(wtl::mt64());
+        uniform[i] = wtl::generate_canonical(wtl::mt64()) * 1.2 - 0.1;
+    }
+    wtl::ThreadPool pool(4);
+    WTL_ASSERT(wtl::bincount(pool, many.begin(), many.end(), 32u) == wtl::bincount(many, 32u));
+    WTL_ASSERT(wtl::histogram(pool, uniform.begin(), uniform.end(), 10u, 0.0, 1.0)
+               == wtl::histogram(uniform, 10u, 0.0, 1.0));
+    const std::vector<double> edges{0.0, 0.1, 0.5, 0.9, 1.0};
+    WTL_ASSERT(wtl::histogram(pool, uniform.begin(), uniform.end(), edges)
+               == wtl::histogram(uniform, edges));
+}
+
+inline void test_rolling() {
+    std::vector<double> x(1000);
+    for (auto& x_i: x) {x_i = 1e6 + wtl::generate_canonical(wtl::mt64());}
+    const size_t window = 50u;
+    for (const size_t step: {1u, 7u, 60u}) {
+        const auto n = wtl::rolling_size(x.size(), window, step);
+        std::vector<double> mean(n), var(n), min(n), max(n);
+        WTL_ASSERT(wtl::rolling_mean(x.begin(), x.end(), window, mean.begin(), step) == mean.end());
+        wtl::rolling_var(x.begin(), x.end(), window, var.begin(), step);
+        wtl::rolling_min(x.begin(), x.end(), window, min.begin(), step);
+        wtl::rolling_max(x.begin(), x.end(), window, max.begin(), step);
+        for (size_t k=0; k<n; ++k) {
+            const auto begin_ = x.begin() + static_cast<ptrdiff_t>(k * step);
+            const auto end_ = begin_ + static_cast<ptrdiff_t>(window);
+            WTL_ASSERT(wtl::approx(mean[k], wtl::mean(begin_, end_), 1e-8));
+            WTL_ASSERT(wtl::approx(var[k], wtl::var(begin_, end_), 1e-8));
+            WTL_ASSERT(min[k] == *std::min_element(begin_, end_));
+            WTL_ASSERT(max[k] == *std::max_element(begin_, end_));
+        }
+    }
+    WTL_ASSERT(wtl::rolling_size(10u, 11u) == 0u);
+    WTL_ASSERT(wtl::rolling_size(10u, 3u, 3u) == 3u);
+    for (const auto& args: std::vector<std::pair<size_t, size_t>>{{0u, 1u}, {3u, 0u}}) {
+        std::vector<double> out(x.size());
+        bool caught = false;
+        try {wtl::rolling_size(x.size(), args.first, args.second);}
+        catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+        caught = false;
+        try {wtl::rolling_mean(x.begin(), x.end(), args.first, out.begin(), args.second);}
+        catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+        caught = false;
+        try {wtl::rolling_max(x.begin(), x.end(), args.first, out.begin(), args.second);}
+        catch (const std::invalid_argument&) {caught = true;}
+        WTL_ASSERT(caught);
+    }
+}
+
+inline void test_diversity() {
+    std::vector<ptrdiff_t> counts(50);
+    std::uniform_int_distribution<ptrdiff_t> dist(0, 100);
+    for (auto& n_i: counts) {n_i = dist(wtl::mt64());}
+    wtl::DiversityTracker<ptrdiff_t> tracker(counts, 100u);
+    std::uniform_int_distribution<size_t> index(0u, counts.size() - 1u);
+    for (int generation=0; generation<1000; ++generation) {
+        const auto i = index(wtl::mt64());
+        counts[i] = dist(wtl::mt64());
+        tracker.set(i, counts[i]);
+        tracker.add(index(wtl::mt64()), 0);
+        WTL_ASSERT(wtl::approx(tracker.shannon(), wtl::shannon_diversity(counts), 1e-12));
+        WTL_ASSERT(wtl::approx(tracker.simpson(), wtl::simpson_diversity(counts), 1e-12));
+    }
+    WTL_ASSERT(tracker.counts() == counts);
+}
+
 int main() {
     test_integral();
+    test_integral_adaptive();
     test_valarray();
+    test_matrix();
+    test_histogram();
+    test_rolling();
+    test_diversity();
     return 0;
 }